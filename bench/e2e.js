@@ -0,0 +1,162 @@
+// End-to-end benchmark of the public index.js API: per-frame latency and throughput of
+// detectSabotage at several resolutions and concurrency levels, as an application sees
+// them (queue, libuv threadpool, decoding and scoring). Prints Google Benchmark style JSON.
+//
+//   node bench/e2e.js [--corpus=DIR] [--concurrency=1,2,4,8] [--duration=SECONDS]
+//                     [--filter=SUBSTRING] [--out=FILE]
+//
+// With --corpus (JPEGs written by `sabotage_bench --write_corpus=DIR`) encoded frames are
+// measured; raw GRAY8 frames generated here are always measured as well.
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+const detector = require('..');
+
+const RESOLUTIONS = [
+  [640, 360],
+  [1280, 720],
+  [1920, 1080],
+  [3840, 2160],
+];
+
+function parseArgs(argv) {
+  const args = { concurrency: [1, 2, 4, 8], duration: 2, filter: '', corpus: null, out: null };
+  for (const arg of argv) {
+    const match = /^--([a-z_]+)=(.*)$/.exec(arg);
+    if (!match) throw new Error(`Unknown argument: ${arg}`);
+    const [, name, value] = match;
+    if (name === 'concurrency') {
+      args.concurrency = value.split(',').map(Number);
+      if (args.concurrency.some((c) => !Number.isInteger(c) || c < 1)) {
+        throw new Error('--concurrency must be a list of positive integers');
+      }
+    } else if (name === 'duration') {
+      args.duration = Number(value);
+    } else if (name === 'filter' || name === 'corpus' || name === 'out') {
+      args[name] = value;
+    } else {
+      throw new Error(`Unknown argument: ${arg}`);
+    }
+  }
+  return args;
+}
+
+// Deterministic textured GRAY8 frame: a gradient with checker blocks and fixed-seed noise.
+// Matches renderScene of the native benchmarks (normal scene), so both corpora hold the same
+// pixels: whole blocks on every other cell of a 2 * block grid, alternating dark and bright.
+function renderRawFrame(width, height) {
+  const data = Buffer.alloc(width * height);
+  let state = 0x9e3779b9;
+  const block = Math.max(8, Math.floor(width / 16));
+  const offset = Math.floor(block / 2);
+  for (let y = 0; y < height; y++) {
+    for (let x = 0; x < width; x++) {
+      state = (Math.imul(state, 1664525) + 1013904223) >>> 0;
+      let value = 60 + Math.floor((120 * x) / width) + Math.floor((40 * y) / height) + (state >>> 28) - 8;
+      const bx = Math.floor((x - offset) / block);
+      const by = Math.floor((y - offset) / block);
+      const inside = offset + (bx + 1) * block < width && offset + (by + 1) * block < height;
+      if (bx >= 0 && by >= 0 && bx % 2 === 0 && by % 2 === 0 && inside) {
+        value = (bx / 2 + by / 2) % 2 ? 230 : 20;
+      }
+      data[y * width + x] = Math.max(0, Math.min(255, value));
+    }
+  }
+  return data;
+}
+
+function percentile(sorted, fraction) {
+  if (sorted.length === 0) return 0;
+  return sorted[Math.min(sorted.length - 1, Math.round(fraction * (sorted.length - 1)))];
+}
+
+// Keeps `concurrency` calls outstanding for `duration` seconds and records each call's latency
+async function measure(name, concurrency, duration, call) {
+  detector.configureQueue({ concurrency });
+  await call(); // Warm up scratch buffers and the threadpool
+
+  const latencies = [];
+  const start = process.hrtime.bigint();
+  const deadline = start + BigInt(Math.round(duration * 1e9));
+  async function client() {
+    while (process.hrtime.bigint() < deadline) {
+      const begin = process.hrtime.bigint();
+      await call();
+      latencies.push(Number(process.hrtime.bigint() - begin));
+    }
+  }
+  await Promise.all(Array.from({ length: concurrency }, client));
+  const elapsed = Number(process.hrtime.bigint() - start) / 1e9;
+
+  latencies.sort((a, b) => a - b);
+  const total = latencies.reduce((sum, latency) => sum + latency, 0);
+  return {
+    name,
+    run_type: 'iteration',
+    iterations: latencies.length,
+    real_time: latencies.length ? total / latencies.length : 0,
+    time_unit: 'ns',
+    p50_time: percentile(latencies, 0.5),
+    p99_time: percentile(latencies, 0.99),
+    items_per_second: latencies.length / elapsed,
+    concurrency,
+  };
+}
+
+function listCases(args) {
+  const cases = [];
+  for (const [width, height] of RESOLUTIONS) {
+    const frame = renderRawFrame(width, height);
+    const frameInfo = { width, height, format: 'GRAY8' };
+    cases.push({
+      name: `e2e_detectSabotageRaw/${width}x${height}/normal`,
+      call: () => detector.detectSabotageRaw(frame, frameInfo),
+    });
+  }
+  if (args.corpus) {
+    for (const file of fs.readdirSync(args.corpus).filter((f) => f.endsWith('.jpg')).sort()) {
+      const buffer = fs.readFileSync(path.join(args.corpus, file));
+      const label = path.basename(file, '.jpg').replace('-', '/');
+      cases.push({ name: `e2e_detectSabotage/${label}`, call: () => detector.detectSabotage(buffer) });
+      cases.push({
+        name: `e2e_detectSabotage_scale4/${label}`,
+        call: () => detector.detectSabotage(buffer, { analysisScale: 4 }),
+      });
+    }
+  }
+  return cases;
+}
+
+async function main() {
+  const args = parseArgs(process.argv.slice(2));
+  const benchmarks = [];
+  for (const testCase of listCases(args)) {
+    for (const concurrency of args.concurrency) {
+      const name = `${testCase.name}/c${concurrency}`;
+      if (args.filter && !name.includes(args.filter)) continue;
+      benchmarks.push(await measure(name, concurrency, args.duration, testCase.call));
+    }
+  }
+
+  const report = {
+    context: {
+      date: new Date().toISOString(),
+      num_cpus: os.cpus().length,
+      node_version: process.version,
+      uv_threadpool_size: Number(process.env.UV_THREADPOOL_SIZE) || 4,
+      parallelism: detector.configure().parallelism,
+    },
+    benchmarks,
+  };
+  const json = `${JSON.stringify(report, null, 2)}\n`;
+  if (args.out) {
+    fs.writeFileSync(args.out, json);
+  } else {
+    process.stdout.write(json);
+  }
+}
+
+main().catch((error) => {
+  console.error(error.message);
+  process.exitCode = 1;
+});
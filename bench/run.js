@@ -0,0 +1,83 @@
+// Runs the whole benchmark suite (`npm run bench`): rebuilds the addon together with the
+// native sabotage_bench binary, runs the native benchmarks, writes the JPEG corpus and runs
+// the end-to-end harness on it, then writes both reports as one JSON document.
+//
+//   npm run bench -- [--out=FILE] [--filter=SUBSTRING] [--min_time=SECONDS]
+//                    [--concurrency=1,2,4,8] [--duration=SECONDS] [--no_build]
+const { spawnSync } = require('child_process');
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+
+const root = path.join(__dirname, '..');
+
+function parseArgs(argv) {
+  const args = { out: path.join(root, 'bench-results.json'), build: true, filter: '', minTime: 0.5, e2e: [] };
+  for (const arg of argv) {
+    const match = /^--([a-z_]+)(?:=(.*))?$/.exec(arg);
+    if (!match) throw new Error(`Unknown argument: ${arg}`);
+    const [, name, value] = match;
+    if (name === 'no_build') {
+      args.build = false;
+    } else if (name === 'out') {
+      args.out = path.resolve(value);
+    } else if (name === 'filter') {
+      args.filter = value;
+      args.e2e.push(arg);
+    } else if (name === 'min_time') {
+      args.minTime = Number(value);
+    } else if (name === 'concurrency' || name === 'duration') {
+      args.e2e.push(arg);
+    } else {
+      throw new Error(`Unknown argument: ${arg}`);
+    }
+  }
+  return args;
+}
+
+function run(command, commandArgs, env) {
+  const result = spawnSync(command, commandArgs, { cwd: root, stdio: 'inherit', env: { ...process.env, ...env } });
+  if (result.error) throw result.error;
+  if (result.status !== 0) {
+    throw new Error(`${path.basename(command)} exited with status ${result.status}`);
+  }
+}
+
+function main() {
+  const args = parseArgs(process.argv.slice(2));
+  if (args.build) {
+    run(process.execPath, [require.resolve('node-gyp/bin/node-gyp.js'), 'rebuild'], { SABOTAGE_BUILD_BENCH: 'true' });
+  }
+
+  const binary = path.join(root, 'build', 'Release', process.platform === 'win32' ? 'sabotage_bench.exe' : 'sabotage_bench');
+  const workDir = fs.mkdtempSync(path.join(os.tmpdir(), 'sabotage-bench-'));
+  try {
+    const corpusDir = path.join(workDir, 'corpus');
+    fs.mkdirSync(corpusDir);
+    run(binary, [`--write_corpus=${corpusDir}`]);
+
+    const nativeOut = path.join(workDir, 'native.json');
+    const nativeArgs = ['--benchmark_format=json', `--benchmark_out=${nativeOut}`, `--benchmark_min_time=${args.minTime}`];
+    if (args.filter) nativeArgs.push(`--benchmark_filter=${args.filter}`);
+    run(binary, nativeArgs);
+
+    const e2eOut = path.join(workDir, 'e2e.json');
+    run(process.execPath, [path.join(__dirname, 'e2e.js'), `--corpus=${corpusDir}`, `--out=${e2eOut}`, ...args.e2e]);
+
+    const report = {
+      native: JSON.parse(fs.readFileSync(nativeOut, 'utf8')),
+      e2e: JSON.parse(fs.readFileSync(e2eOut, 'utf8')),
+    };
+    fs.writeFileSync(args.out, `${JSON.stringify(report, null, 2)}\n`);
+    console.log(`Benchmark results written to ${args.out}`);
+  } finally {
+    fs.rmSync(workDir, { recursive: true, force: true });
+  }
+}
+
+try {
+  main();
+} catch (error) {
+  console.error(error.message);
+  process.exitCode = 1;
+}
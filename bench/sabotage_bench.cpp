@@ -0,0 +1,406 @@
+// Native benchmarks of the sabotage detector core: decoding, each feature stage and score,
+// the full per-frame pipeline and scene change, over a synthetic corpus at several
+// resolutions. Command line and JSON output follow Google Benchmark, so results can be
+// compared with the usual tooling; the runner is self-contained to keep the build free of
+// extra dependencies.
+//
+//   sabotage_bench [--benchmark_filter=SUBSTRING] [--benchmark_min_time=SECONDS]
+//                  [--benchmark_format=json|console] [--benchmark_out=FILE]
+//                  [--intra_frame] [--write_corpus=DIR]
+#include "sabotage_core.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef SABOTAGE_BENCH_BUILD_TYPE
+#ifdef NDEBUG
+#define SABOTAGE_BENCH_BUILD_TYPE "release"
+#else
+#define SABOTAGE_BENCH_BUILD_TYPE "debug"
+#endif
+#endif
+
+namespace {
+
+struct Resolution {
+    const char* name;
+    int width;
+    int height;
+};
+
+const Resolution kResolutions[] = {
+    {"640x360", 640, 360},
+    {"1280x720", 1280, 720},
+    {"1920x1080", 1920, 1080},
+    {"3840x2160", 3840, 2160},
+};
+
+// Scenes the corpus is made of: a textured scene and the sabotage cases derived from it
+enum class Scene { Normal, Dark, Bright, Blur };
+
+const char* sceneName(Scene scene) {
+    switch (scene) {
+        case Scene::Normal: return "normal";
+        case Scene::Dark: return "dark";
+        case Scene::Bright: return "bright";
+        case Scene::Blur: return "blur";
+    }
+    return "";
+}
+
+const Scene kScenes[] = {Scene::Normal, Scene::Dark, Scene::Bright, Scene::Blur};
+const size_t kSceneCount = sizeof(kScenes) / sizeof(kScenes[0]);
+
+// Helper function to render a deterministic grayscale test scene: a lit gradient with
+// rectangles (sharp edges) and fixed-seed noise (texture), so every run scores the same pixels
+cv::Mat renderScene(const Resolution& resolution, Scene scene) {
+    cv::Mat gray(resolution.height, resolution.width, CV_8UC1);
+    uint32_t state = 0x9e3779b9u;
+    for (int y = 0; y < gray.rows; y++) {
+        uchar* row = gray.ptr<uchar>(y);
+        for (int x = 0; x < gray.cols; x++) {
+            state = state * 1664525u + 1013904223u;
+            int base = 60 + 120 * x / gray.cols + 40 * y / gray.rows;
+            row[x] = cv::saturate_cast<uchar>(base + static_cast<int>(state >> 28) - 8);
+        }
+    }
+    int block = std::max(8, resolution.width / 16);
+    for (int y = block / 2; y + block < gray.rows; y += 2 * block) {
+        for (int x = block / 2; x + block < gray.cols; x += 2 * block) {
+            // Blocks sit on every other cell of a 2 * block grid; alternate them dark and bright
+            int shade = ((x / (2 * block) + y / (2 * block)) % 2) ? 230 : 20;
+            cv::rectangle(gray, cv::Rect(x, y, block, block), cv::Scalar(shade), -1);
+        }
+    }
+
+    switch (scene) {
+        case Scene::Normal:
+            break;
+        case Scene::Dark:
+            gray.convertTo(gray, CV_8UC1, 0.08);
+            break;
+        case Scene::Bright:
+            gray.convertTo(gray, CV_8UC1, 0.2, 215);
+            break;
+        case Scene::Blur: {
+            int kernel = (resolution.width / 64) | 1;
+            cv::GaussianBlur(gray, gray, cv::Size(kernel, kernel), 0);
+            break;
+        }
+    }
+    return gray;
+}
+
+struct CorpusFrame {
+    Resolution resolution;
+    Scene scene;
+    cv::Mat gray;
+    std::vector<uchar> jpeg;
+};
+
+std::vector<CorpusFrame> buildCorpus() {
+    std::vector<CorpusFrame> corpus;
+    for (const Resolution& resolution : kResolutions) {
+        for (Scene scene : kScenes) {
+            CorpusFrame frame{resolution, scene, renderScene(resolution, scene), {}};
+            cv::imencode(".jpg", frame.gray, frame.jpeg, {cv::IMWRITE_JPEG_QUALITY, 90});
+            corpus.push_back(std::move(frame));
+        }
+    }
+    return corpus;
+}
+
+// Keeps a computed value alive so the optimizer cannot drop the work producing it
+template <typename T>
+void doNotOptimize(const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "g"(&value) : "memory");
+#else
+    static const void* volatile sink;
+    sink = &value;
+#endif
+}
+
+// Measurements of one benchmark, in nanoseconds per iteration
+struct Result {
+    std::string name;
+    size_t iterations = 0;
+    double realTime = 0.0;
+    double cpuTime = 0.0;
+    double p50 = 0.0;
+    double p99 = 0.0;
+    double bytesPerSecond = 0.0;
+    double itemsPerSecond = 0.0;
+};
+
+struct Benchmark {
+    std::string name;
+    std::function<void()> run;  // One iteration
+    size_t bytesPerIteration;   // Input pixels or encoded bytes, for throughput
+};
+
+double percentile(std::vector<double> samples, double fraction) {
+    if (samples.empty()) return 0.0;
+    size_t index = static_cast<size_t>(fraction * (samples.size() - 1) + 0.5);
+    std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+    return samples[index];
+}
+
+// Helper function to time a benchmark: one warm-up iteration (so scratch buffers are sized),
+// then iterations until minTime has elapsed, with at least 10 samples for the percentiles
+Result runBenchmark(const Benchmark& benchmark, double minTime) {
+    using Clock = std::chrono::steady_clock;
+    benchmark.run();
+
+    std::vector<double> samples;
+    std::clock_t cpuStart = std::clock();
+    Clock::time_point start = Clock::now();
+    double elapsed = 0.0;
+    while (elapsed < minTime || samples.size() < 10) {
+        Clock::time_point begin = Clock::now();
+        benchmark.run();
+        Clock::time_point end = Clock::now();
+        samples.push_back(std::chrono::duration<double, std::nano>(end - begin).count());
+        elapsed = std::chrono::duration<double>(end - start).count();
+    }
+    double cpuSeconds = static_cast<double>(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+
+    Result result;
+    result.name = benchmark.name;
+    result.iterations = samples.size();
+    result.realTime = elapsed * 1e9 / samples.size();
+    result.cpuTime = cpuSeconds * 1e9 / samples.size();
+    result.p50 = percentile(samples, 0.5);
+    result.p99 = percentile(samples, 0.99);
+    result.itemsPerSecond = samples.size() / elapsed;
+    result.bytesPerSecond = result.itemsPerSecond * benchmark.bytesPerIteration;
+    return result;
+}
+
+// Helper function to register the benchmarks of one corpus frame
+void addFrameBenchmarks(const CorpusFrame& frame, const CorpusFrame& previous, std::vector<Benchmark>& benchmarks) {
+    const cv::Mat& gray = frame.gray;
+    std::string suffix = std::string("/") + frame.resolution.name + "/" + sceneName(frame.scene);
+    size_t pixels = gray.total();
+    size_t encoded = frame.jpeg.size();
+    const cv::Mat noMask;
+
+    benchmarks.push_back({"decode" + suffix, [&frame] {
+        doNotOptimize(readImageFromBuffer(frame.jpeg.data(), frame.jpeg.size()));
+    }, encoded});
+    benchmarks.push_back({"decode_reduced4" + suffix, [&frame] {
+        doNotOptimize(readImageFromBuffer(frame.jpeg.data(), frame.jpeg.size(), grayscaleReadFlag(4)));
+    }, encoded});
+
+    benchmarks.push_back({"stage_histogram" + suffix, [&gray, noMask] {
+        FrameFeatures features;
+        computeHistogramStage(gray, noMask, kAllMetrics, features);
+        doNotOptimize(features);
+    }, pixels});
+    benchmarks.push_back({"stage_structure_canny" + suffix, [&gray, noMask] {
+        FrameFeatures features;
+        computeStructureStage(gray, noMask, 1, kAllMetrics, features, EdgeEstimator::Canny);
+        doNotOptimize(features);
+    }, pixels});
+    benchmarks.push_back({"stage_structure_gradient" + suffix, [&gray, noMask] {
+        FrameFeatures features;
+        computeStructureStage(gray, noMask, 1, kAllMetrics, features, EdgeEstimator::Gradient);
+        doNotOptimize(features);
+    }, pixels});
+    benchmarks.push_back({"stage_structure_pyramid" + suffix, [&gray, noMask] {
+        FramePyramid pyramid;
+        pyramid.reset(gray);
+        FrameFeatures features;
+        computePyramidStructureStage(pyramid, noMask, 1, kAllMetrics, 3, features, EdgeEstimator::Canny);
+        doNotOptimize(features);
+    }, pixels});
+
+    // Each score on its own, including the stage it needs, as the metrics option runs it
+    struct MetricBenchmark {
+        const char* name;
+        uint32_t metrics;
+    };
+    const MetricBenchmark metricBenchmarks[] = {
+        {"defocus", kMetricDefocus},
+        {"blackout", kMetricBlackout},
+        {"flash", kMetricFlash},
+        {"smear", kMetricSmear},
+    };
+    for (const MetricBenchmark& metric : metricBenchmarks) {
+        uint32_t metrics = metric.metrics;
+        benchmarks.push_back({std::string("score_") + metric.name + suffix, [&gray, noMask, metrics] {
+            FrameFeatures features = computeFrameFeatures(gray, 1, metrics, noMask);
+            double score = 0.0;
+            if (metrics & kMetricDefocus) score = calculateDefocusScore(features);
+            if (metrics & kMetricBlackout) score = calculateBlackoutScore(features);
+            if (metrics & kMetricFlash) score = calculateFlashScore(features);
+            if (metrics & kMetricSmear) score = calculateSmearScore(features, calculateDefocusScore(features));
+            doNotOptimize(score);
+        }, pixels});
+    }
+    benchmarks.push_back({"score_sceneChange" + suffix, [&gray, &previous] {
+        doNotOptimize(calculateSceneChangeScore(gray, previous.gray));
+    }, pixels});
+
+    AnalysisOptions defaults;
+    AnalysisOptions cascade;
+    cascade.cascade = true;
+    AnalysisOptions grid;
+    grid.gridRows = grid.gridCols = 4;
+    benchmarks.push_back({"detectSabotage" + suffix, [&gray, defaults] {
+        doNotOptimize(computeSabotageScores(gray, defaults));
+    }, pixels});
+    benchmarks.push_back({"detectSabotage_cascade" + suffix, [&gray, cascade] {
+        doNotOptimize(computeSabotageScores(gray, cascade));
+    }, pixels});
+    benchmarks.push_back({"detectSabotage_grid4" + suffix, [&gray, grid] {
+        doNotOptimize(computeSabotageScores(gray, grid));
+    }, pixels});
+    benchmarks.push_back({"detectSabotage_decoded" + suffix, [&frame, defaults] {
+        cv::Mat decoded = readImageFromBuffer(frame.jpeg.data(), frame.jpeg.size());
+        doNotOptimize(computeSabotageScores(decoded, defaults));
+    }, encoded});
+}
+
+std::string jsonEscape(const std::string& text) {
+    std::string escaped;
+    for (char c : text) {
+        if (c == '"' || c == '\\') escaped += '\\';
+        escaped += c;
+    }
+    return escaped;
+}
+
+void writeJson(FILE* out, const std::vector<Result>& results, bool intraFrame) {
+    char date[64];
+    std::time_t now = std::time(nullptr);
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+
+    std::fprintf(out, "{\n  \"context\": {\n");
+    std::fprintf(out, "    \"date\": \"%s\",\n", date);
+    std::fprintf(out, "    \"num_cpus\": %u,\n", std::thread::hardware_concurrency());
+    std::fprintf(out, "    \"opencv_version\": \"%s\",\n", CV_VERSION);
+    std::fprintf(out, "    \"opencv_threads\": %d,\n", cv::getNumThreads());
+    std::fprintf(out, "    \"parallelism\": \"%s\",\n", intraFrame ? "intraFrame" : "frame");
+    std::fprintf(out, "    \"library_build_type\": \"%s\"\n", SABOTAGE_BENCH_BUILD_TYPE);
+    std::fprintf(out, "  },\n  \"benchmarks\": [\n");
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result& r = results[i];
+        std::fprintf(out,
+                     "    {\"name\": \"%s\", \"run_type\": \"iteration\", \"iterations\": %zu, "
+                     "\"real_time\": %.1f, \"cpu_time\": %.1f, \"time_unit\": \"ns\", "
+                     "\"p50_time\": %.1f, \"p99_time\": %.1f, "
+                     "\"bytes_per_second\": %.1f, \"items_per_second\": %.3f}%s\n",
+                     jsonEscape(r.name).c_str(), r.iterations, r.realTime, r.cpuTime, r.p50, r.p99,
+                     r.bytesPerSecond, r.itemsPerSecond, i + 1 < results.size() ? "," : "");
+    }
+    std::fprintf(out, "  ]\n}\n");
+}
+
+void writeConsole(FILE* out, const std::vector<Result>& results) {
+    std::fprintf(out, "%-52s %14s %14s %14s %10s\n", "Benchmark", "Time (us)", "p50 (us)", "p99 (us)", "Iterations");
+    for (const Result& r : results) {
+        std::fprintf(out, "%-52s %14.1f %14.1f %14.1f %10zu\n", r.name.c_str(), r.realTime / 1e3, r.p50 / 1e3,
+                     r.p99 / 1e3, r.iterations);
+    }
+}
+
+// Helper function to write the corpus as JPEGs, e.g. for the Node harness
+bool writeCorpus(const std::vector<CorpusFrame>& corpus, const std::string& directory) {
+    for (const CorpusFrame& frame : corpus) {
+        std::string path = directory + "/" + frame.resolution.name + "-" + sceneName(frame.scene) + ".jpg";
+        FILE* file = std::fopen(path.c_str(), "wb");
+        if (file == nullptr) return false;
+        bool written = std::fwrite(frame.jpeg.data(), 1, frame.jpeg.size(), file) == frame.jpeg.size();
+        if (std::fclose(file) != 0 || !written) return false;
+    }
+    return true;
+}
+
+// Helper function to read the value of a --name=value flag
+bool readFlag(const char* arg, const char* name, std::string& value) {
+    size_t length = std::strlen(name);
+    if (std::strncmp(arg, name, length) != 0 || arg[length] != '=') return false;
+    value = arg + length + 1;
+    return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    std::string filter, format = "console", outPath, corpusDirectory, minTimeValue;
+    double minTime = 0.5;
+    bool intraFrame = false;
+    for (int i = 1; i < argc; i++) {
+        if (readFlag(argv[i], "--benchmark_filter", filter) || readFlag(argv[i], "--benchmark_format", format) ||
+            readFlag(argv[i], "--benchmark_out", outPath) || readFlag(argv[i], "--write_corpus", corpusDirectory)) {
+            continue;
+        }
+        if (readFlag(argv[i], "--benchmark_min_time", minTimeValue)) {
+            minTime = std::atof(minTimeValue.c_str());
+            continue;
+        }
+        if (std::strcmp(argv[i], "--intra_frame") == 0) {
+            intraFrame = true;
+            continue;
+        }
+        std::fprintf(stderr, "Unknown argument: %s\n", argv[i]);
+        return 2;
+    }
+    if (format != "json" && format != "console") {
+        std::fprintf(stderr, "--benchmark_format must be json or console\n");
+        return 2;
+    }
+
+    try {
+        std::vector<CorpusFrame> corpus = buildCorpus();
+        if (!corpusDirectory.empty()) {
+            if (!writeCorpus(corpus, corpusDirectory)) {
+                std::fprintf(stderr, "Failed to write corpus to %s\n", corpusDirectory.c_str());
+                return 1;
+            }
+            return 0;
+        }
+
+        // Single-threaded by default so numbers measure per-frame cost, as the 'frame' policy runs
+        cv::setNumThreads(0);
+        parallelismConfig().intraFrame.store(intraFrame);
+
+        std::vector<Benchmark> benchmarks;
+        for (size_t i = 0; i < corpus.size(); i++) {
+            // The scene change reference is the normal scene at the same resolution
+            const CorpusFrame& previous = corpus[i - i % kSceneCount];
+            addFrameBenchmarks(corpus[i], previous, benchmarks);
+        }
+
+        std::vector<Result> results;
+        for (const Benchmark& benchmark : benchmarks) {
+            if (!filter.empty() && benchmark.name.find(filter) == std::string::npos) continue;
+            results.push_back(runBenchmark(benchmark, minTime));
+        }
+
+        FILE* out = outPath.empty() ? stdout : std::fopen(outPath.c_str(), "w");
+        if (out == nullptr) {
+            std::fprintf(stderr, "Failed to open %s\n", outPath.c_str());
+            return 1;
+        }
+        if (format == "json") {
+            writeJson(out, results, intraFrame);
+        } else {
+            writeConsole(out, results);
+        }
+        if (out != stdout) std::fclose(out);
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "Benchmark failed: %s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
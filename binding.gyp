@@ -1,11 +1,13 @@
 {
-    "targets": [{
-        "target_name": "camera_sabotage_detector",
+    "variables": {
+        "build_bench%": "<!(node -p \"process.env.SABOTAGE_BUILD_BENCH || 'false'\")",
+        "build_tests%": "<!(node -p \"process.env.SABOTAGE_BUILD_TESTS || 'false'\")",
+        "with_videoio%": "<!(node -p \"process.env.SABOTAGE_WITH_VIDEOIO || 'false'\")"
+    },
+    "target_defaults": {
         "cflags!": ["-fno-exceptions"],
         "cflags_cc!": ["-fno-exceptions", "-fno-rtti"],
-        "sources": ["src/camera_sabotage_detector.cpp"],
         "include_dirs": [
-            "<!@(node -p \"require('node-addon-api').include\")",
             "/usr/local/include/opencv4",
             "/usr/include/opencv4"
         ],
@@ -14,8 +16,11 @@
             "-lopencv_imgcodecs",
             "-lopencv_imgproc"
         ],
-        "defines": ["NAPI_DISABLE_CPP_EXCEPTIONS"],
         "conditions": [
+            ["with_videoio=='true'", {
+                "defines": ["SABOTAGE_WITH_VIDEOIO"],
+                "libraries": ["-lopencv_videoio"]
+            }],
             ["OS=='mac'", {
                 "xcode_settings": {
                     "GCC_ENABLE_CPP_EXCEPTIONS": "YES",
@@ -52,5 +57,45 @@
                 "RuntimeTypeInfo": "true"
             }
         }
-    }]
+    },
+    "targets": [{
+        "target_name": "sabotage_core",
+        "type": "static_library",
+        "sources": ["src/sabotage_core.cpp", "src/sabotage_files.cpp"],
+        "cflags": ["-fPIC"],
+        "conditions": [
+            ["with_videoio=='true'", {
+                "sources": ["src/sabotage_stream.cpp"]
+            }]
+        ],
+        "direct_dependent_settings": {
+            "include_dirs": ["src"]
+        }
+    }, {
+        "target_name": "camera_sabotage_detector",
+        "dependencies": ["sabotage_core"],
+        "sources": ["src/camera_sabotage_detector.cpp"],
+        "include_dirs": [
+            "<!@(node -p \"require('node-addon-api').include\")"
+        ],
+        "defines": ["NAPI_DISABLE_CPP_EXCEPTIONS"]
+    }],
+    "conditions": [
+        ["build_bench=='true'", {
+            "targets": [{
+                "target_name": "sabotage_bench",
+                "type": "executable",
+                "dependencies": ["sabotage_core"],
+                "sources": ["bench/sabotage_bench.cpp"]
+            }]
+        }],
+        ["build_tests=='true'", {
+            "targets": [{
+                "target_name": "sabotage_core_test",
+                "type": "executable",
+                "dependencies": ["sabotage_core"],
+                "sources": ["test/sabotage_core_test.cpp"]
+            }]
+        }]
+    ]
 }
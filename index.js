@@ -1,88 +1,572 @@
-const { Worker, isMainThread, parentPort } = require('worker_threads');
-
-if (!isMainThread) {
-  // Worker thread code
-  const { detectSabotage: nativeDetectSabotage, detectSceneChange: nativeDetectSceneChange } = require('./build/Release/camera_sabotage_detector');
-
-  parentPort.on('message', async (message) => {
-    try {
-      let result;
-      if (message.type === 'sabotage') {
-        result = nativeDetectSabotage(message.input);
-      } else if (message.type === 'sceneChange') {
-        result = nativeDetectSceneChange(message.current, message.previous);
-      }
-      parentPort.postMessage({ success: true, result });
-    } catch (error) {
-      parentPort.postMessage({ success: false, error: error.message });
-    }
+const { EventEmitter } = require('events');
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+const native = require('./build/Release/camera_sabotage_detector');
+
+// Bounded scheduler in front of the native async calls. At most `concurrency`
+// frames are handed to the libuv threadpool at once and at most `maxQueueSize`
+// more wait here; anything beyond that is rejected instead of buffered. The default
+// concurrency matches the libuv threadpool (UV_THREADPOOL_SIZE, 4 unless set), capped by the
+// core count, so frames counted as in flight are actually running.
+const queue = {
+  concurrency: Math.max(1, Math.min(Number(process.env.UV_THREADPOOL_SIZE) || 4, os.cpus().length || 1)),
+  maxQueueSize: 1024,
+  inFlight: 0,
+  pending: [],
+  rejected: 0,
+};
+
+function runTask(task) {
+  queue.inFlight++;
+  let promise;
+  try {
+    promise = Promise.resolve(task());
+  } catch (error) {
+    promise = Promise.reject(error);
+  }
+  return promise.finally(releaseSlot);
+}
+
+function releaseSlot() {
+  queue.inFlight--;
+  drainQueue();
+}
+
+function drainQueue() {
+  while (queue.inFlight < queue.concurrency && queue.pending.length > 0) {
+    const next = queue.pending.shift();
+    runTask(next.task).then(next.resolve, next.reject);
+  }
+}
+
+function schedule(task) {
+  if (queue.inFlight < queue.concurrency) {
+    return runTask(task);
+  }
+  if (queue.pending.length >= queue.maxQueueSize) {
+    queue.rejected++;
+    const error = new Error(
+      `Sabotage detection queue is full (${queue.inFlight} in flight, ${queue.pending.length} queued)`
+    );
+    error.code = 'ERR_QUEUE_FULL';
+    return Promise.reject(error);
+  }
+  return new Promise((resolve, reject) => {
+    queue.pending.push({ task, resolve, reject });
   });
-  return;
+}
+
+/**
+ * Configures the bounded queue shared by all detection calls.
+ * @param {Object} options
+ * @param {number} [options.concurrency] - Maximum number of frames processed at once
+ *   (default: UV_THREADPOOL_SIZE or 4, at most the number of cores)
+ * @param {number} [options.maxQueueSize] - Maximum number of frames waiting for a slot before calls are rejected (default: 1024)
+ */
+function configureQueue(options = {}) {
+  if (options.concurrency !== undefined) {
+    if (!Number.isInteger(options.concurrency) || options.concurrency < 1) {
+      throw new TypeError('concurrency must be a positive integer');
+    }
+    queue.concurrency = options.concurrency;
+  }
+  if (options.maxQueueSize !== undefined) {
+    if (!Number.isInteger(options.maxQueueSize) || options.maxQueueSize < 0) {
+      throw new TypeError('maxQueueSize must be a non-negative integer');
+    }
+    queue.maxQueueSize = options.maxQueueSize;
+  }
+  drainQueue();
+}
+
+/**
+ * Returns the current state of the detection queue.
+ * @returns {Object} Object containing:
+ *   - inFlight {number} - Frames currently being processed
+ *   - queued {number} - Frames waiting for a free slot
+ *   - rejected {number} - Calls rejected with ERR_QUEUE_FULL since startup
+ *   - concurrency {number} - Configured maximum in-flight frames
+ *   - maxQueueSize {number} - Configured maximum queued frames
+ */
+function getQueueStats() {
+  return {
+    inFlight: queue.inFlight,
+    queued: queue.pending.length,
+    rejected: queue.rejected,
+    concurrency: queue.concurrency,
+    maxQueueSize: queue.maxQueueSize,
+  };
+}
+
+/**
+ * Configures native parallelism. Two policies are available:
+ *   - 'frame' (default): every frame runs on a single thread. Single calls and sessions use one
+ *     libuv threadpool thread per frame, batches spread their frames over the native pool.
+ *     Best throughput when many frames are in flight; pair it with opencvThreads: 0 so OpenCV
+ *     does not start its own threads inside each frame.
+ *   - 'intraFrame': single calls and sessions split each frame into row stripes scored on the
+ *     native pool. Lowest latency for a few large frames. Batches always stay frame-level.
+ * @param {Object} [options] - Settings to change; omitted settings are kept
+ * @param {number} [options.opencvThreads] - Threads OpenCV may use inside one call (cv::setNumThreads;
+ *   0 runs OpenCV functions on the calling thread)
+ * @param {number} [options.poolThreads] - Threads in the native pool used by batches and row stripes
+ *   (default: number of cores)
+ * @param {string} [options.parallelism] - 'frame' or 'intraFrame'
+ * @param {boolean} [options.stageStats] - Collect process-wide stage durations for getStageStats()
+ *   (default: false; when off, stages are not timed at all)
+ * @param {number} [options.analysisBudget] - Milliseconds of full analysis per second shared by all
+ *   sessions with sampling enabled (0, the default, disables the budget). E.g. 2000 allows about two cores
+ * @returns {Object} The resulting settings: {opencvThreads, poolThreads, parallelism, stageStats,
+ *   analysisBudget}, plus openclAvailable, whether the 'opencl' backend can use a device
+ */
+function configure(options) {
+  return native.configure(options);
+}
+
+/**
+ * Returns the scratch memory kept for reuse between frames. Each thread that has processed
+ * frames keeps its intermediate images, sized to the largest frame it has seen.
+ * @returns {Object} Object containing:
+ *   - bytes {number} - Pooled bytes over all threads
+ *   - threads {number} - Threads holding a scratch pool
+ */
+function getScratchMemory() {
+  return native.getScratchMemory();
+}
+
+/**
+ * Frees the pooled scratch memory of all threads, e.g. after a burst of large frames.
+ * Frames in progress finish first; later frames simply allocate again.
+ * @returns {number} Number of bytes released
+ */
+function releaseScratchMemory() {
+  return native.releaseScratchMemory();
+}
+
+/**
+ * Returns process-wide stage statistics collected while configure({ stageStats: true }) is in
+ * effect. Durations are kept in log-scale histograms (two buckets per doubling from 1 us), so
+ * percentiles are estimates within a bucket.
+ * @returns {Object} Object containing:
+ *   - enabled {boolean} - Whether statistics are currently collected
+ *   - frames {number} - Frames processed (the count of the 'total' stage)
+ *   - bucketBoundsMs {Array<number>} - Upper bucket bounds in milliseconds, the last one Infinity
+ *   - stages {Object} - Per stage ('decode', 'histogram', 'laplacian', 'edges', 'grid',
+ *     'sceneChange', 'total'): {count, totalMs, p50Ms, p99Ms, bucketCounts}, where bucketCounts
+ *     are cumulative per bound, as in a Prometheus histogram
+ */
+function getStageStats() {
+  return native.getStageStats();
+}
+
+/**
+ * Clears the statistics reported by getStageStats().
+ */
+function resetStageStats() {
+  native.resetStageStats();
 }
 
 /**
  * Asynchronously detects various types of camera sabotage in an image.
- * The function runs in a separate worker thread to ensure non-blocking operation.
+ * Decoding and scoring run on the libuv threadpool to ensure non-blocking operation.
+ * Rejects with an error whose code is 'ERR_QUEUE_FULL' when the queue is saturated.
+ * Buffers are decoded in place and must not be modified until the promise settles.
  * @param {string|Buffer} input - Image file path or buffer containing image data
+ * @param {Object} [options] - Analysis options
+ * @param {number} [options.analysisScale=1] - Analyse at 1/scale resolution (1, 2, 4 or 8);
+ *   JPEGs are decoded directly at the reduced size. Defocus and smear are rescaled approximately, so
+ *   compare them only between results at the same scale
+ * @param {Array<string>|number} [options.metrics] - Metrics to compute, as names ('defocus', 'blackout',
+ *   'flash', 'smear', 'sceneChange') or a bitmask of METRICS; unselected scores are omitted and
+ *   their processing stages skipped (default: all)
+ * @param {boolean|Object} [options.cascade=false] - Run the cheap histogram scores first and skip
+ *   defocus/smear when blackout or flash reaches `cascade.threshold` (default 95); such results
+ *   carry shortCircuited: true
+ * @param {Array<Object>} [options.roi] - {x, y, width, height} rectangles in full-resolution pixels
+ *   (integers; x and y from 0, width and height from 1); all metrics are computed only over their union
+ * @param {Array<Object>} [options.excludeRoi] - Rectangles left out of the analysis, e.g. overlays
+ * @param {Object} [options.mask] - {data: Buffer, width, height} with one byte per pixel; non-zero
+ *   pixels are analysed. Combined with roi/excludeRoi into one mask, so the frame is scanned once
+ * @param {number|Object} [options.grid] - Also score each tile of an N x N or {rows, cols} grid
+ *   (1-16 per dimension) to catch partial occlusion; all tiles come from one pass over the frame.
+ *   The cascade is not applied in grid mode
+ * @param {string} [options.edgeEstimator='canny'] - Edge density used by smearScore: 'canny' runs
+ *   cv::Canny, 'gradient' counts strong Sobel gradients inside the Laplacian pass (faster, calibrated
+ *   to approximate the Canny value)
+ * @param {string} [options.defocusEstimator='laplacian'] - 'pyramid' estimates defocus from the median
+ *   of the Laplacian energy over a pyrDown chain (less sensitive to noise and resolution) and takes
+ *   smear edges from the half-resolution level. Runs on the CPU; not used in grid mode
+ * @param {number} [options.pyramidLevels=3] - Levels of the pyramid estimator, counting the
+ *   analysis frame (2-4)
+ * @param {string} [options.backend='cpu'] - 'opencl' runs the histogram, Laplacian, edge and difference
+ *   stages on an OpenCL device through cv::UMat (one upload per frame, same scores); without OpenCL
+ *   it silently runs on the CPU. Grid mode always runs on the CPU
+ * @param {boolean} [options.timings=false] - Add the durations of the stages that ran to the result
  * @returns {Promise<Object>} Promise resolving to an object containing:
  *   - defocusScore {number} - 0-100 score indicating defocus level
  *   - blackoutScore {number} - 0-100 score indicating blackout level
  *   - flashScore {number} - 0-100 score indicating flash level
  *   - smearScore {number} - 0-100 score indicating smear level
+ *   - grid {Object} - Only with options.grid: {rows, cols, defocusScores, blackoutScores,
+ *     flashScores, smearScores, max}, one Float64Array entry per tile in row-major order
+ *     (NaN for tiles outside the analysed region) and the highest tile score of each metric
+ *   - timings {Object} - Only with options.timings: milliseconds per stage that ran ('decode',
+ *     'histogram', 'laplacian', 'edges', 'grid', 'sceneChange') and 'total' for the whole call
  */
-async function detectSabotage(input) {
-  return new Promise((resolve, reject) => {
-    const worker = new Worker(__filename);
-
-    worker.on('message', (message) => {
-      if (message.success) {
-        resolve(message.result);
-      } else {
-        reject(new Error(message.error));
-      }
-      worker.terminate();
-    });
-
-    worker.on('error', (error) => {
-      reject(error);
-      worker.terminate();
-    });
-
-    worker.postMessage({ type: 'sabotage', input });
-  });
+async function detectSabotage(input, options) {
+  return schedule(() => native.detectSabotageAsync(input, options));
+}
+
+/**
+ * Asynchronously detects camera sabotage in an already decoded frame, skipping image decoding.
+ * For GRAY8, NV12 and I420 frames the luma plane is used in place without copying.
+ * The buffer must not be modified until the promise settles.
+ * @param {Buffer} buffer - Raw pixel data; for YUV formats the Y plane must come first
+ * @param {Object} frameInfo - Frame layout
+ * @param {number} frameInfo.width - Frame width in pixels
+ * @param {number} frameInfo.height - Frame height in pixels
+ * @param {number} [frameInfo.stride] - Bytes per row of the first plane (default: tightly packed)
+ * @param {string} frameInfo.format - One of 'GRAY8', 'NV12', 'I420' or 'BGR'
+ * @param {Object} [options] - Analysis options, as for detectSabotage
+ * @returns {Promise<Object>} Promise resolving to the same scores as detectSabotage
+ */
+async function detectSabotageRaw(buffer, frameInfo, options) {
+  return schedule(() => native.detectSabotageRawAsync(buffer, frameInfo, options));
+}
+
+/**
+ * Asynchronously scores only lens smear in an image, skipping the other metrics.
+ * The image is decoded straight to grayscale on the libuv threadpool.
+ * @param {string|Buffer} input - Image file path or buffer containing image data
+ * @param {Object} [options] - Analysis options, as for detectSabotage (metrics and cascade are ignored)
+ * @returns {Promise<Object>} Promise resolving to an object containing:
+ *   - smearScore {number} - 0-100 score indicating smear level
+ */
+async function detectSmear(input, options) {
+  return schedule(() => native.detectSmearAsync(input, options));
+}
+
+/**
+ * Asynchronously scores a batch of frames in one call. Frames are decoded and scored in
+ * parallel on a native thread pool sized to the number of cores.
+ * @param {Array<string|Buffer|Object>} frames - Image paths, encoded buffers, or raw frames as
+ *   {data, width, height, stride, format} (see detectSabotageRaw)
+ * @param {Object} [options] - Analysis options, as for detectSabotage, plus:
+ * @param {Float64Array} [options.output] - Caller-owned array of at least frames.length * RESULT_STRIDE
+ *   elements; results are written into it at RESULT_SLOTS offsets instead of allocating objects.
+ *   Cannot be combined with options.timings
+ * @returns {Promise<Array<Object>|Float64Array>} Promise resolving to one entry per frame, in input
+ *   order: the detectSabotage scores, or {error} if that frame could not be processed.
+ *   When options.output is given, resolves to that array instead.
+ */
+async function detectSabotageBatch(frames, options) {
+  return schedule(() => native.detectSabotageBatchAsync(frames, options));
+}
+
+/**
+ * Scores image files for offline reprocessing. Files are memory-mapped ahead of the decoders by
+ * a prefetch thread, decoded at reduced scale and scored by decoder threads of the job, so
+ * reading and decoding overlap. The job runs beside the detection queue: it occupies one libuv
+ * threadpool thread as a decoder, starts the remaining decoders itself and leaves the native pool
+ * to batches.
+ * @param {Array<string>} paths - Image file paths
+ * @param {Object} [options] - Analysis options, as for detectSabotage, plus:
+ * @param {number} [options.prefetch=32] - Files mapped ahead of the decoders (1-4096)
+ * @param {number} [options.decoders] - Decoder threads (1-256), one per native pool thread by default
+ * @param {string} [options.output] - NDJSON file receiving one line per file:
+ *   {index, path, <scores>} or {index, path, error}
+ * @param {Function} [options.onResult] - Called with each result as it completes: the
+ *   detectSabotage scores plus index and path, or {index, path, error}. Results arrive in
+ *   completion order; the job slows down while more than 64 wait for the event loop
+ * @param {AbortSignal} [options.signal] - Aborting stops the job after the files in progress; the
+ *   promise then resolves with cancelled: true and the counts so far
+ * @returns {Promise<Object>} Promise resolving, after the last result, to
+ *   {processed, failed, elapsedMs, cancelled}
+ */
+async function processFiles(paths, options = {}) {
+  const { onResult, signal, ...nativeOptions } = options;
+  if (signal && signal.aborted) {
+    return { processed: 0, failed: 0, elapsedMs: 0, cancelled: true };
+  }
+  const job = native.processFiles(paths, nativeOptions, onResult);
+  if (!signal || !job.cancel) return job.promise;
+  const onAbort = () => job.cancel();
+  signal.addEventListener('abort', onAbort, { once: true });
+  try {
+    return await job.promise;
+  } finally {
+    signal.removeEventListener('abort', onAbort);
+  }
+}
+
+// Helper function to list the files of a directory with one of the given extensions
+async function listImageFiles(directory, recursive, extensions) {
+  const files = [];
+  const entries = await fs.promises.readdir(directory, { withFileTypes: true });
+  for (const entry of entries.sort((a, b) => (a.name < b.name ? -1 : a.name > b.name ? 1 : 0))) {
+    const fullPath = path.join(directory, entry.name);
+    if (entry.isDirectory()) {
+      if (recursive) files.push(...(await listImageFiles(fullPath, recursive, extensions)));
+    } else if (entry.isFile() && extensions.includes(path.extname(entry.name).toLowerCase())) {
+      files.push(fullPath);
+    }
+  }
+  return files;
+}
+
+/**
+ * Scores every image file of a directory with processFiles. Files are taken in name order,
+ * which is also the order of result indexes.
+ * @param {string} directory - Directory to scan
+ * @param {Object} [options] - processFiles options, plus:
+ * @param {boolean} [options.recursive=true] - Include subdirectories
+ * @param {Array<string>} [options.extensions=['.jpg', '.jpeg', '.png']] - File extensions to include
+ *   (compared in lower case)
+ * @returns {Promise<Object>} Promise resolving to the processFiles summary plus files, the scanned paths
+ */
+async function scanDirectory(directory, options = {}) {
+  const { recursive = true, extensions = ['.jpg', '.jpeg', '.png'], ...fileOptions } = options;
+  const files = await listImageFiles(directory, recursive, extensions.map((ext) => ext.toLowerCase()));
+  const summary = await processFiles(files, fileOptions);
+  return { ...summary, files };
 }
 
 /**
  * Asynchronously detects significant changes between two consecutive frames.
- * The function runs in a separate worker thread to ensure non-blocking operation.
+ * Decoding and comparison run on the libuv threadpool to ensure non-blocking operation.
+ * Rejects with an error whose code is 'ERR_QUEUE_FULL' when the queue is saturated.
  * @param {string|Buffer} current - Current frame image path or buffer
  * @param {string|Buffer} previous - Previous frame image path or buffer
+ * @param {Object} [options] - Analysis options, as for detectSabotage
  * @returns {Promise<Object>} Promise resolving to an object containing:
  *   - sceneChangeScore {number} - 0-100 score indicating scene change level
  */
-async function detectSceneChange(current, previous) {
-  return new Promise((resolve, reject) => {
-    const worker = new Worker(__filename);
-
-    worker.on('message', (message) => {
-      if (message.success) {
-        resolve(message.result);
-      } else {
-        reject(new Error(message.error));
-      }
-      worker.terminate();
-    });
-
-    worker.on('error', (error) => {
-      reject(error);
-      worker.terminate();
-    });
-
-    worker.postMessage({ type: 'sceneChange', current, previous });
-  });
+async function detectSceneChange(current, previous, options) {
+  return schedule(() => native.detectSceneChangeAsync(current, previous, options));
 }
 
+// Helper function to list the metric names selected by a METRICS bitmask
+function metricNames(bits) {
+  return METRIC_NAMES.filter((name, i) => bits & (1 << i));
+}
+
+// Helper function to build the 'alert' event of a session result, or null without a transition
+function alertEvent(result) {
+  let active;
+  let changed;
+  if (result instanceof Float64Array) {
+    const changedBits = result[RESULT_SLOTS.ALERTS_CHANGED];
+    if (!changedBits) return null; // 0, or NaN when alerts are disabled
+    active = metricNames(result[RESULT_SLOTS.ALERTS]);
+    changed = metricNames(changedBits);
+  } else {
+    if (!result.alerts || result.alerts.changed.length === 0) return null;
+    ({ active, changed } = result.alerts);
+  }
+  return {
+    active,
+    raised: changed.filter((name) => active.includes(name)),
+    cleared: changed.filter((name) => !active.includes(name)),
+  };
+}
+
+/**
+ * Per-camera analysis session. Scene-change state is kept natively, so every call returns
+ * all sabotage scores plus scene change while each frame is decoded only once.
+ * Await each call before submitting the next frame to keep frames in order.
+ *
+ * With the alerts option, each score is smoothed over time and turned into a raised/cleared
+ * alert with N-of-M hysteresis. Results then carry `alerts`, and the session emits:
+ *   - 'alert' ({active, raised, cleared}) - Only on frames that raised or cleared an alert;
+ *     each field is an array of metric names
+ */
+class CameraSession extends EventEmitter {
+  /**
+   * @param {Object} [options] - Analysis options, as for detectSabotage, plus:
+   * @param {string} [options.sceneChangeMode='background'] - 'background' compares each frame with an
+   *   exponentially weighted background, 'previous' with the previous frame
+   * @param {number} [options.backgroundAlpha=0.1] - Weight of each new frame in the background (0-1]
+   * @param {number} [options.backgroundScale=4] - Extra downscale of the analysis frame for the background grid
+   * @param {boolean|Object} [options.alerts=false] - Temporal alert filtering; true selects the defaults:
+   * @param {number} [options.alerts.alpha=0.3] - Weight of each new score in the moving average (0-1]
+   * @param {number} [options.alerts.window=5] - Frames considered by the hysteresis (M, 1-32)
+   * @param {number} [options.alerts.required=3] - Frames of the window that must agree to raise or clear (N)
+   * @param {number} [options.alerts.hysteresis=10] - An alert clears once the smoothed score is this far
+   *   below its threshold
+   * @param {Object} [options.alerts.thresholds] - Raise threshold per metric name (0-100, default 50)
+   * @param {boolean|Object} [options.sampling=false] - Adaptive sampling; true selects the defaults:
+   * @param {number} [options.sampling.changeThreshold=5] - Thumbnail change score (0-100) against the last
+   *   analysed frame above which a frame is analysed immediately
+   * @param {number} [options.sampling.maxInterval=16] - Stable cameras back off to one analysis every
+   *   maxInterval frames; the frames in between reuse the last scores
+   * @param {boolean|Object} [options.dedup=false] - Perceptual-hash frame cache; true selects the defaults:
+   * @param {number} [options.dedup.maxDistance=2] - Hash bits (0-64) two frames may differ in to share scores
+   * @param {number} [options.dedup.cacheSize=16] - Recently analysed frames kept in the cache
+   * @param {number} [options.dedup.frozenFrames=50] - Consecutive identical hashes that mark the feed frozen
+   * @param {number} [options.dedup.brightnessBits=4] - Leading bits (0-8) of the mean brightness that
+   *     must also match, so uniform frames of different brightness never share scores
+   */
+  constructor(options) {
+    super();
+    this._native = new native.CameraSession(options);
+  }
+
+  _notify(result) {
+    const event = alertEvent(result);
+    if (event) this.emit('alert', event);
+    return result;
+  }
+
+  /**
+   * Scores a frame and compares it with the previous frame of this session.
+   * @param {string|Buffer} input - Image file path or buffer containing image data
+   * @param {Float64Array} [output] - Caller-owned array of at least RESULT_STRIDE elements to write
+   *   the result into at RESULT_SLOTS offsets instead of allocating an object; frames written
+   *   there are not timed
+   * @returns {Promise<Object|Float64Array>} Promise resolving to the detectSabotage scores plus:
+   *   - sceneChangeScore {number} - 0-100 score against the background or previous frame (0 for the first frame)
+   *   - alerts {Object} - With the alerts option: {active, changed} arrays of metric names and
+   *     smoothed, the moving average of each computed score
+   *   - reused {boolean} - With the sampling option: the frame was not analysed and the scores are
+   *     those of the last analysed frame (sceneChangeScore is always current)
+   *   - changeScore {number} - With the sampling option: thumbnail change against the last analysed frame
+   *   - cached {boolean} - With the dedup option: the scores are those of a cached frame with a matching hash
+   *   - frozenScore {number} - With the dedup option: 0-100, reaching 100 once the frame hash stayed
+   *     identical for frozenFrames frames
+   *   When output is given, resolves to that array instead (alerts in the ALERTS slots, the rest as
+   *   RESULT_FLAGS.REUSED, CACHED and FROZEN).
+   */
+  process(input, output) {
+    return schedule(() => this._native.process(input, output)).then((result) => this._notify(result));
+  }
+
+  /**
+   * Same as process() for an already decoded frame, see detectSabotageRaw.
+   * @param {Buffer} buffer - Raw pixel data
+   * @param {Object} frameInfo - Frame layout {width, height, stride, format}
+   * @param {Float64Array} [output] - Caller-owned result array, as for process()
+   * @returns {Promise<Object|Float64Array>} Promise resolving to the same result as process()
+   */
+  processRaw(buffer, frameInfo, output) {
+    return schedule(() => this._native.processRaw(buffer, frameInfo, output)).then((result) => this._notify(result));
+  }
+
+  /**
+   * Forgets the background, previous frame and alert state, e.g. after the camera was repositioned.
+   */
+  reset() {
+    this._native.reset();
+  }
+}
+
+/**
+ * Native stream source (requires a build with SABOTAGE_WITH_VIDEOIO=true). A dedicated native
+ * thread opens the stream through OpenCV videoio, analyses `fps` frames per second of stream
+ * time and skips the others without decoding them. Analysed frames run through a per-camera
+ * session, so results include sceneChangeScore.
+ *
+ * Events:
+ *   - 'result' (result) - detectSabotage scores plus sceneChangeScore, frameIndex and timestamp (ms)
+ *   - 'alert' ({active, raised, cleared, frameIndex, timestamp}) - With the alerts option, as for CameraSession
+ *   - 'error' (error) - A frame failed (error.frameIndex is set), or the stream could not be opened.
+ *     Only emitted while an 'error' listener is attached; otherwise the error is kept in `lastError`
+ *     instead of crashing the process
+ *   - 'end' ({framesRead, dropped, error}) - The stream ended or stop() took effect. `dropped` counts
+ *     results discarded because the event loop fell more than 16 results behind; `error` is set when
+ *     the stream failed
+ */
+class VideoSource extends EventEmitter {
+  /**
+   * @param {string} url - Stream URL (e.g. rtsp://...) or video file path
+   * @param {Object} [options] - CameraSession options, plus:
+   * @param {number} [options.fps=1] - Frames analysed per second of stream time
+   */
+  constructor(url, options) {
+    super();
+    if (!native.VideoSource) {
+      throw new Error('VideoSource is not available: rebuild with SABOTAGE_WITH_VIDEOIO=true');
+    }
+    this.started = false;
+    this.ended = false;
+    this.lastError = null;
+    this._native = new native.VideoSource(url, options, (event) => this._onEvent(event));
+  }
+
+  /**
+   * Opens the stream and starts analysing frames.
+   * @returns {VideoSource} this
+   */
+  start() {
+    this._native.start();
+    this.started = true;
+    return this;
+  }
+
+  /**
+   * Stops reading after the frame in progress.
+   * @returns {Promise<void>} Promise resolving once the 'end' event was emitted
+   */
+  stop() {
+    if (!this.started || this.ended) {
+      this.ended = true;
+      return Promise.resolve();
+    }
+    const ended = new Promise((resolve) => this.once('end', () => resolve()));
+    this._native.stop();
+    return ended;
+  }
+
+  _onEvent(event) {
+    const { type, ...data } = event;
+    if (type === 'result') {
+      this.emit('result', data);
+      const alert = alertEvent(data);
+      if (alert) this.emit('alert', { ...alert, frameIndex: data.frameIndex, timestamp: data.timestamp });
+    } else if (type === 'error') {
+      const error = new Error(data.message);
+      error.frameIndex = data.frameIndex;
+      this._fail(error);
+    } else {
+      this.ended = true;
+      const error = data.error ? new Error(data.error) : undefined;
+      if (error) this._fail(error);
+      this.emit('end', { framesRead: data.framesRead, dropped: data.dropped, error });
+    }
+  }
+
+  // Helper function to report a failure without throwing from an unhandled 'error' event
+  _fail(error) {
+    this.lastError = error;
+    if (this.listenerCount('error') > 0) this.emit('error', error);
+  }
+}
+
+// Float64Array result layout: RESULT_STRIDE doubles per frame, scores at the RESULT_SLOTS
+// offsets, and a bitmask of RESULT_FLAGS in the FLAGS slot. Missing values are NaN.
+// With session alerts, the ALERTS and ALERTS_CHANGED slots hold METRICS bitmasks.
+const { RESULT_SLOTS, RESULT_STRIDE, RESULT_FLAGS, METRICS } = native;
+const METRIC_NAMES = ['defocus', 'blackout', 'flash', 'smear', 'sceneChange'];
+
 module.exports = {
   detectSabotage,
+  detectSabotageRaw,
+  detectSabotageBatch,
   detectSceneChange,
+  detectSmear,
+  processFiles,
+  scanDirectory,
+  CameraSession,
+  VideoSource,
+  configure,
+  configureQueue,
+  getQueueStats,
+  getScratchMemory,
+  releaseScratchMemory,
+  getStageStats,
+  resetStageStats,
+  RESULT_SLOTS,
+  RESULT_STRIDE,
+  RESULT_FLAGS,
+  METRICS,
 };
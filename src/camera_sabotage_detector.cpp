@@ -1,82 +1,525 @@
 #include <napi.h>
-#include <opencv2/opencv.hpp>
+#include "sabotage_core.h"
+#include "sabotage_files.h"
+#ifdef SABOTAGE_WITH_VIDEOIO
+#include "sabotage_stream.h"
+#endif
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <string>
 #include <vector>
 
-// Helper function to read image from buffer
-cv::Mat readImageFromBuffer(const Napi::Buffer<uint8_t>& buffer) {
-    std::vector<uint8_t> vec(buffer.Data(), buffer.Data() + buffer.Length());
-    return cv::imdecode(vec, cv::IMREAD_GRAYSCALE);
-}
-
-// Helper function to calculate defocus score
-double calculateDefocusScore(const cv::Mat& gray) {
-    cv::Mat laplacian;
-    cv::Laplacian(gray, laplacian, CV_64F);
-    
-    cv::Scalar mean, stddev;
-    cv::meanStdDev(laplacian, mean, stddev);
-    
-    double variance = stddev.val[0] * stddev.val[0];
-    return 100.0 - std::min(100.0, variance / 10.0);
-}
-
-// Helper function to calculate blackout score
-double calculateBlackoutScore(const cv::Mat& gray) {
-    double avgIntensity = cv::mean(gray)[0];
-    
-    // Calculate percentage of dark pixels
-    cv::Mat hist;
-    int histSize = 256;
-    float range[] = {0, 256};
-    const float* histRange = {range};
-    cv::calcHist(&gray, 1, 0, cv::Mat(), hist, 1, &histSize, &histRange);
-    
-    double darkPixels = 0;
-    for (int i = 0; i < 75; i++) {  // Count pixels with intensity 0-74
-        darkPixels += hist.at<float>(i);
-    }
-    double totalPixels = gray.rows * gray.cols;
-    double darkPercentage = (darkPixels / totalPixels) * 100.0;
-    
-    // Moderately sensitive blackout detection
-    // Detect blackout when average intensity is below 60
-    // and there's a moderate percentage of dark pixels
-    double intensityScore = std::max(0.0, (60.0 - avgIntensity) * 1.5);
-    double darkPixelScore = darkPercentage * 0.6;
-    return std::min(100.0, intensityScore + darkPixelScore);
-}
-
-// Helper function to calculate flash score
-double calculateFlashScore(const cv::Mat& gray) {
-    cv::Mat hist;
-    int histSize = 256;
-    float range[] = {0, 256};
-    const float* histRange = {range};
-    cv::calcHist(&gray, 1, 0, cv::Mat(), hist, 1, &histSize, &histRange);
-    
-    // Calculate percentage of bright pixels
-    double highIntensityPixels = 0;
-    for (int i = 200; i < 256; i++) {
-        highIntensityPixels += hist.at<float>(i);
-    }
-    double totalPixels = gray.rows * gray.cols;
-    double brightPercentage = (highIntensityPixels / totalPixels) * 100.0;
-    
-    // Convert to 0-100 scale where higher means more flash
-    return std::min(100.0, std::max(0.0, brightPercentage * 3.0));
-}
-
-// Helper function to calculate scene change score
-double calculateSceneChangeScore(const cv::Mat& current, const cv::Mat& previous) {
-    if (previous.empty()) return 0.0;
-    
-    cv::Mat diff;
-    cv::absdiff(current, previous, diff);
-    double avgDiff = cv::mean(diff)[0];
-    
-    // Convert to 0-100 scale where higher means more change
-    // Assuming significant change starts at 50.0 difference
-    return std::min(100.0, std::max(0.0, (avgDiff / 50.0) * 100.0));
+// Image argument captured on the main thread so it can be decoded on a worker thread.
+// Buffers are not copied: they are kept alive by a persistent reference until the
+// worker is destroyed and decoded in place.
+struct ImageInput {
+    enum class Kind { Path, Encoded, Raw };
+
+    Kind kind = Kind::Path;
+    std::string path;
+    const uint8_t* data = nullptr;
+    size_t length = 0;
+    Napi::ObjectReference bufferRef;
+
+    // Raw frame layout, only used when kind == Kind::Raw
+    int width = 0;
+    int height = 0;
+    int stride = 0;
+    PixelFormat format = PixelFormat::Gray8;
+};
+
+// Helper function to capture a string (file path) or buffer argument
+bool readImageInput(const Napi::Value& value, ImageInput& input) {
+    if (value.IsString()) {
+        input.kind = ImageInput::Kind::Path;
+        input.path = value.As<Napi::String>().Utf8Value();
+        return true;
+    }
+    if (value.IsBuffer()) {
+        Napi::Buffer<uint8_t> buffer = value.As<Napi::Buffer<uint8_t>>();
+        input.kind = ImageInput::Kind::Encoded;
+        input.data = buffer.Data();
+        input.length = buffer.Length();
+        input.bufferRef = Napi::Persistent(buffer.As<Napi::Object>());
+        return true;
+    }
+    return false;
+}
+
+// Helper function to read a positive integer property from a frame description
+bool readFrameDimension(const Napi::Object& frameInfo, const char* name, int& value) {
+    Napi::Value property = frameInfo.Get(name);
+    if (!property.IsNumber()) return false;
+    double number = property.As<Napi::Number>().DoubleValue();
+    if (!(number >= 1.0) || number > 65535.0 || number != std::floor(number)) return false;
+    value = static_cast<int>(number);
+    return true;
+}
+
+// Helper function to read a pixel offset property: an integer from 0 to 65535
+bool readFrameOffset(const Napi::Object& frameInfo, const char* name, int& value) {
+    Napi::Value property = frameInfo.Get(name);
+    if (!property.IsNumber()) return false;
+    double number = property.As<Napi::Number>().DoubleValue();
+    if (!(number >= 0.0) || number > 65535.0 || number != std::floor(number)) return false;
+    value = static_cast<int>(number);
+    return true;
+}
+
+// Helper function to capture a raw frame buffer and its {width, height, stride, format}
+// description. Returns an error message, or an empty string on success.
+std::string readRawImageInput(const Napi::Value& value, const Napi::Value& frameInfoValue, ImageInput& input) {
+    if (!value.IsBuffer()) {
+        return "Expected buffer argument for raw frame";
+    }
+    if (!frameInfoValue.IsObject()) {
+        return "Expected {width, height, stride, format} frame description";
+    }
+    Napi::Object frameInfo = frameInfoValue.As<Napi::Object>();
+
+    if (!readFrameDimension(frameInfo, "width", input.width) ||
+        !readFrameDimension(frameInfo, "height", input.height)) {
+        return "Frame width and height must be positive integers";
+    }
+
+    Napi::Value formatValue = frameInfo.Get("format");
+    std::string format = formatValue.IsString() ? formatValue.As<Napi::String>().Utf8Value() : "";
+    int bytesPerPixel = 1;
+    if (format == "GRAY8") {
+        input.format = PixelFormat::Gray8;
+    } else if (format == "NV12") {
+        input.format = PixelFormat::NV12;
+    } else if (format == "I420") {
+        input.format = PixelFormat::I420;
+    } else if (format == "BGR") {
+        input.format = PixelFormat::BGR;
+        bytesPerPixel = 3;
+    } else {
+        return "Frame format must be one of GRAY8, NV12, I420 or BGR";
+    }
+
+    input.stride = input.width * bytesPerPixel;
+    if (!frameInfo.Get("stride").IsUndefined() && !readFrameDimension(frameInfo, "stride", input.stride)) {
+        return "Frame stride must be a positive integer";
+    }
+    if (input.stride < input.width * bytesPerPixel) {
+        return "Frame stride is smaller than one row of pixels";
+    }
+
+    // Only the first plane is read, so that is all the buffer has to hold
+    Napi::Buffer<uint8_t> buffer = value.As<Napi::Buffer<uint8_t>>();
+    size_t required = static_cast<size_t>(input.stride) * (input.height - 1) +
+                      static_cast<size_t>(input.width) * bytesPerPixel;
+    if (buffer.Length() < required) {
+        return "Buffer is too small for the described frame";
+    }
+
+    input.kind = ImageInput::Kind::Raw;
+    input.data = buffer.Data();
+    input.length = buffer.Length();
+    input.bufferRef = Napi::Persistent(buffer.As<Napi::Object>());
+    return "";
+}
+
+// Helper function to read a list of {x, y, width, height} rectangles
+std::string readRects(const Napi::Value& value, const char* name, std::vector<cv::Rect>& rects) {
+    std::string error =
+        std::string(name) + " must be an array of {x, y, width, height} rectangles with integer pixel coordinates";
+    if (!value.IsArray()) return error;
+    Napi::Array array = value.As<Napi::Array>();
+    for (uint32_t i = 0; i < array.Length(); i++) {
+        Napi::Value item = array.Get(i);
+        if (!item.IsObject()) return error;
+        Napi::Object rect = item.As<Napi::Object>();
+        int left = 0, top = 0, width = 0, height = 0;
+        if (!readFrameOffset(rect, "x", left) || !readFrameOffset(rect, "y", top) ||
+            !readFrameDimension(rect, "width", width) || !readFrameDimension(rect, "height", height)) {
+            return error;
+        }
+        rects.emplace_back(left, top, width, height);
+    }
+    return "";
+}
+
+// Helper function to read a {data, width, height} mask; the data is copied and binarised
+std::string readMask(const Napi::Value& value, cv::Mat& mask) {
+    std::string error = "mask must be {data: Buffer, width, height} with one byte per pixel";
+    if (!value.IsObject()) return error;
+    Napi::Object object = value.As<Napi::Object>();
+    int width = 0, height = 0;
+    Napi::Value data = object.Get("data");
+    if (!data.IsBuffer() || !readFrameDimension(object, "width", width) ||
+        !readFrameDimension(object, "height", height)) {
+        return error;
+    }
+    Napi::Buffer<uint8_t> buffer = data.As<Napi::Buffer<uint8_t>>();
+    if (buffer.Length() < static_cast<size_t>(width) * height) return error;
+
+    mask.create(height, width, CV_8UC1);
+    const uint8_t* source = buffer.Data();
+    for (int y = 0; y < height; y++) {
+        uchar* row = mask.ptr<uchar>(y);
+        for (int x = 0; x < width; x++) {
+            row[x] = source[static_cast<size_t>(y) * width + x] ? 255 : 0;
+        }
+    }
+    return "";
+}
+
+// Metric names in bit order
+const char* const kMetricNames[kMetricCount] = {"defocus", "blackout", "flash", "smear", "sceneChange"};
+
+// Helper function to map a metric name to its bit, or 0 if unknown
+uint32_t metricFromName(const std::string& name) {
+    if (name == "defocus") return kMetricDefocus;
+    if (name == "blackout") return kMetricBlackout;
+    if (name == "flash") return kMetricFlash;
+    if (name == "smear") return kMetricSmear;
+    if (name == "sceneChange") return kMetricSceneChange;
+    return 0;
+}
+
+// Helper function to read a metric selection given as a bitmask or an array of names
+std::string readMetrics(const Napi::Value& value, uint32_t& metrics) {
+    if (value.IsNumber()) {
+        double number = value.As<Napi::Number>().DoubleValue();
+        if (!(number >= 1.0 && number <= kAllMetrics) || number != std::floor(number)) {
+            return "metrics bitmask must select at least one known metric";
+        }
+        metrics = static_cast<uint32_t>(number);
+        return "";
+    }
+    if (!value.IsArray()) {
+        return "metrics must be an array of metric names or a bitmask";
+    }
+    Napi::Array names = value.As<Napi::Array>();
+    metrics = 0;
+    for (uint32_t i = 0; i < names.Length(); i++) {
+        Napi::Value name = names.Get(i);
+        uint32_t metric = name.IsString() ? metricFromName(name.As<Napi::String>().Utf8Value()) : 0;
+        if (metric == 0) {
+            return "Unknown metric; expected defocus, blackout, flash, smear or sceneChange";
+        }
+        metrics |= metric;
+    }
+    if (metrics == 0) {
+        return "metrics must select at least one metric";
+    }
+    return "";
+}
+
+// Helper function to read an options object; undefined selects the defaults.
+// Returns an error message, or an empty string on success.
+std::string readAnalysisOptions(const Napi::Value& value, AnalysisOptions& options) {
+    if (value.IsUndefined() || value.IsNull()) return "";
+    if (!value.IsObject()) return "Expected options object";
+    Napi::Object object = value.As<Napi::Object>();
+
+    Napi::Value scale = object.Get("analysisScale");
+    if (!scale.IsUndefined()) {
+        double number = scale.IsNumber() ? scale.As<Napi::Number>().DoubleValue() : 0.0;
+        if (number != 1.0 && number != 2.0 && number != 4.0 && number != 8.0) {
+            return "analysisScale must be 1, 2, 4 or 8";
+        }
+        options.analysisScale = static_cast<int>(number);
+    }
+
+    Napi::Value metrics = object.Get("metrics");
+    if (!metrics.IsUndefined()) {
+        std::string error = readMetrics(metrics, options.metrics);
+        if (!error.empty()) return error;
+    }
+
+    // cascade: true, or cascade: { threshold }
+    Napi::Value cascade = object.Get("cascade");
+    if (cascade.IsBoolean()) {
+        options.cascade = cascade.As<Napi::Boolean>().Value();
+    } else if (cascade.IsObject()) {
+        options.cascade = true;
+        Napi::Value threshold = cascade.As<Napi::Object>().Get("threshold");
+        if (!threshold.IsUndefined()) {
+            double number = threshold.IsNumber() ? threshold.As<Napi::Number>().DoubleValue() : -1.0;
+            if (!(number >= 0.0 && number <= 100.0)) {
+                return "cascade.threshold must be between 0 and 100";
+            }
+            options.cascadeThreshold = number;
+        }
+    } else if (!cascade.IsUndefined()) {
+        return "cascade must be a boolean or {threshold}";
+    }
+
+    // edgeEstimator: 'canny' | 'gradient'
+    Napi::Value edgeEstimator = object.Get("edgeEstimator");
+    if (!edgeEstimator.IsUndefined()) {
+        std::string name = edgeEstimator.IsString() ? edgeEstimator.As<Napi::String>().Utf8Value() : "";
+        if (name == "canny") {
+            options.edgeEstimator = EdgeEstimator::Canny;
+        } else if (name == "gradient") {
+            options.edgeEstimator = EdgeEstimator::Gradient;
+        } else {
+            return "edgeEstimator must be 'canny' or 'gradient'";
+        }
+    }
+
+    // defocusEstimator: 'laplacian' | 'pyramid'
+    Napi::Value defocusEstimator = object.Get("defocusEstimator");
+    if (!defocusEstimator.IsUndefined()) {
+        std::string name = defocusEstimator.IsString() ? defocusEstimator.As<Napi::String>().Utf8Value() : "";
+        if (name == "laplacian") {
+            options.defocusEstimator = DefocusEstimator::Laplacian;
+        } else if (name == "pyramid") {
+            options.defocusEstimator = DefocusEstimator::Pyramid;
+        } else {
+            return "defocusEstimator must be 'laplacian' or 'pyramid'";
+        }
+    }
+
+    Napi::Value pyramidLevels = object.Get("pyramidLevels");
+    if (!pyramidLevels.IsUndefined()) {
+        double number = pyramidLevels.IsNumber() ? pyramidLevels.As<Napi::Number>().DoubleValue() : 0.0;
+        if (!(number >= 2.0 && number <= kMaxPyramidLevels) || number != std::floor(number)) {
+            return "pyramidLevels must be an integer between 2 and " + std::to_string(kMaxPyramidLevels);
+        }
+        options.pyramidLevels = static_cast<int>(number);
+    }
+
+    // backend: 'cpu' | 'opencl'
+    Napi::Value backend = object.Get("backend");
+    if (!backend.IsUndefined()) {
+        std::string name = backend.IsString() ? backend.As<Napi::String>().Utf8Value() : "";
+        if (name == "cpu") {
+            options.backend = Backend::Cpu;
+        } else if (name == "opencl") {
+            options.backend = Backend::OpenCL;
+        } else {
+            return "backend must be 'cpu' or 'opencl'";
+        }
+    }
+
+    Napi::Value timings = object.Get("timings");
+    if (!timings.IsUndefined()) {
+        if (!timings.IsBoolean()) return "timings must be a boolean";
+        options.timings = timings.As<Napi::Boolean>().Value();
+    }
+
+    // grid: N for an N x N grid, or grid: { rows, cols }
+    Napi::Value grid = object.Get("grid");
+    if (!grid.IsUndefined()) {
+        std::string error = "grid must be a tile count or {rows, cols} between 1 and 16";
+        if (grid.IsNumber()) {
+            Napi::Object square = Napi::Object::New(object.Env());
+            square.Set("rows", grid);
+            square.Set("cols", grid);
+            grid = square;
+        }
+        if (!grid.IsObject() ||
+            !readFrameDimension(grid.As<Napi::Object>(), "rows", options.gridRows) ||
+            !readFrameDimension(grid.As<Napi::Object>(), "cols", options.gridCols) ||
+            options.gridRows > 16 || options.gridCols > 16) {
+            return error;
+        }
+    }
+
+    Napi::Value roi = object.Get("roi");
+    Napi::Value excludeRoi = object.Get("excludeRoi");
+    Napi::Value mask = object.Get("mask");
+    if (!roi.IsUndefined() || !excludeRoi.IsUndefined() || !mask.IsUndefined()) {
+        std::shared_ptr<AnalysisRegion> region = std::make_shared<AnalysisRegion>();
+        std::string error;
+        if (!roi.IsUndefined()) error = readRects(roi, "roi", region->include);
+        if (error.empty() && !excludeRoi.IsUndefined()) error = readRects(excludeRoi, "excludeRoi", region->exclude);
+        if (error.empty() && !mask.IsUndefined()) error = readMask(mask, region->mask);
+        if (!error.empty()) return error;
+        options.region = region;
+    }
+    return "";
+}
+
+// Helper function to decode a captured image argument to grayscale at 1/analysisScale resolution
+cv::Mat decodeImageInput(const ImageInput& input, int analysisScale = 1) {
+    StageTimer timer(Stage::Decode);
+    switch (input.kind) {
+        case ImageInput::Kind::Path:
+            return cv::imread(input.path, grayscaleReadFlag(analysisScale));
+        case ImageInput::Kind::Encoded:
+            return readImageFromBuffer(input.data, input.length, grayscaleReadFlag(analysisScale));
+        case ImageInput::Kind::Raw:
+            return downscaleGray(readImageFromRaw({input.data, input.width, input.height, input.stride, input.format}),
+                                 analysisScale);
+    }
+    return cv::Mat();
+}
+
+// Helper function to add per-tile score arrays and their maxima to a result object
+void setGridScores(Napi::Env env, Napi::Object result, const TileGridScores& grid) {
+    Napi::Object object = Napi::Object::New(env);
+    object.Set("rows", Napi::Number::New(env, grid.rows));
+    object.Set("cols", Napi::Number::New(env, grid.cols));
+
+    auto setTileArray = [&](uint32_t metric, const char* name, double SabotageScores::*score) {
+        if (!(grid.max.metrics & metric)) return;
+        Napi::Float64Array values = Napi::Float64Array::New(env, grid.tiles.size());
+        for (size_t i = 0; i < grid.tiles.size(); i++) {
+            values[i] = grid.tiles[i].*score;
+        }
+        object.Set(name, values);
+    };
+    setTileArray(kMetricDefocus, "defocusScores", &SabotageScores::defocusScore);
+    setTileArray(kMetricBlackout, "blackoutScores", &SabotageScores::blackoutScore);
+    setTileArray(kMetricFlash, "flashScores", &SabotageScores::flashScore);
+    setTileArray(kMetricSmear, "smearScores", &SabotageScores::smearScore);
+
+    Napi::Object max = Napi::Object::New(env);
+    if (grid.max.metrics & kMetricDefocus) max.Set("defocusScore", Napi::Number::New(env, grid.max.defocusScore));
+    if (grid.max.metrics & kMetricBlackout) max.Set("blackoutScore", Napi::Number::New(env, grid.max.blackoutScore));
+    if (grid.max.metrics & kMetricFlash) max.Set("flashScore", Napi::Number::New(env, grid.max.flashScore));
+    if (grid.max.metrics & kMetricSmear) max.Set("smearScore", Napi::Number::New(env, grid.max.smearScore));
+    object.Set("max", max);
+
+    result.Set("grid", object);
+}
+
+// Helper function to convert sabotage scores to a JS object
+Napi::Object sabotageScoresToObject(Napi::Env env, const SabotageScores& scores) {
+    Napi::Object result = Napi::Object::New(env);
+    if (scores.metrics & kMetricDefocus) result.Set("defocusScore", Napi::Number::New(env, scores.defocusScore));
+    if (scores.metrics & kMetricBlackout) result.Set("blackoutScore", Napi::Number::New(env, scores.blackoutScore));
+    if (scores.metrics & kMetricFlash) result.Set("flashScore", Napi::Number::New(env, scores.flashScore));
+    if (scores.metrics & kMetricSmear) result.Set("smearScore", Napi::Number::New(env, scores.smearScore));
+    if (scores.shortCircuited) result.Set("shortCircuited", Napi::Boolean::New(env, true));
+    if (scores.grid) setGridScores(env, result, *scores.grid);
+    return result;
+}
+
+// Helper function to add the durations of the stages that ran, in milliseconds, to a result object
+void setTimings(Napi::Env env, Napi::Object result, const StageTimings& timings) {
+    Napi::Object object = Napi::Object::New(env);
+    for (int i = 0; i < kStageCount; i++) {
+        if (timings.recorded & (1u << i)) {
+            object.Set(stageName(static_cast<Stage>(i)), Napi::Number::New(env, timings.milliseconds[i]));
+        }
+    }
+    result.Set("timings", object);
+}
+
+// Slot layout of caller-owned Float64Array results: kResultStride doubles per frame.
+// Scores that were not computed and frames that failed are written as NaN.
+enum ResultSlot {
+    kSlotDefocus = 0,
+    kSlotBlackout = 1,
+    kSlotFlash = 2,
+    kSlotSmear = 3,
+    kSlotSceneChange = 4,
+    kSlotFlags = 5,
+    kSlotAlerts = 6,         // Session alerts: Metric bits raised after the frame
+    kSlotAlertsChanged = 7,  // Session alerts: Metric bits raised or cleared by the frame
+    kResultStride = 8
+};
+
+// Bits of the kSlotFlags slot
+enum ResultFlag {
+    kFlagOk = 1 << 0,
+    kFlagShortCircuited = 1 << 1,
+    kFlagReused = 1 << 2,  // Session sampling reused the scores of the last analysed frame
+    kFlagCached = 1 << 3,  // Session dedup took the scores from a frame with a matching hash
+    kFlagFrozen = 1 << 4   // Session dedup: the hash was constant for frozenFrames frames
+};
+
+// Caller-owned Float64Array that results are written into from worker threads.
+// The array is pinned by a persistent reference until the worker is destroyed.
+struct ResultOutput {
+    double* data = nullptr;
+    size_t length = 0;
+    Napi::ObjectReference arrayRef;
+
+    bool enabled() const { return data != nullptr; }
+    double* slots(size_t frame) const { return data + frame * kResultStride; }
+};
+
+// Helper function to capture an optional Float64Array with room for frameCount results.
+// Returns an error message, or an empty string on success.
+std::string readResultOutput(const Napi::Value& value, size_t frameCount, ResultOutput& output) {
+    if (value.IsUndefined() || value.IsNull()) return "";
+    if (!value.IsTypedArray() || value.As<Napi::TypedArray>().TypedArrayType() != napi_float64_array) {
+        return "Result output must be a Float64Array";
+    }
+    Napi::Float64Array array = value.As<Napi::Float64Array>();
+    if (array.ElementLength() < frameCount * kResultStride) {
+        return "Result output needs " + std::to_string(frameCount * kResultStride) + " elements";
+    }
+    output.data = array.Data();
+    output.length = array.ElementLength();
+    output.arrayRef = Napi::Persistent(array.As<Napi::Object>());
+    return "";
+}
+
+// Helper function to write one frame's result slots; a null scores pointer marks a failure
+void writeResultSlots(double* slots, const SabotageScores* scores, double sceneChangeScore) {
+    std::fill(slots, slots + kResultStride, std::numeric_limits<double>::quiet_NaN());
+    if (scores == nullptr) {
+        slots[kSlotFlags] = 0;
+        return;
+    }
+    slots[kSlotDefocus] = scores->defocusScore;
+    slots[kSlotBlackout] = scores->blackoutScore;
+    slots[kSlotFlash] = scores->flashScore;
+    slots[kSlotSmear] = scores->smearScore;
+    slots[kSlotSceneChange] = sceneChangeScore;
+    slots[kSlotFlags] = kFlagOk | (scores->shortCircuited ? kFlagShortCircuited : 0);
+}
+
+// Helper function to write a session frame's result slots. The alert slots are only written
+// for sessions with alerts enabled.
+void writeSessionSlots(double* slots, const SessionFrame& frame, const SessionOptions& options) {
+    writeResultSlots(slots, &frame.scores, frame.sceneChangeScore);
+    if (frame.reused) slots[kSlotFlags] += kFlagReused;
+    if (frame.cached) slots[kSlotFlags] += kFlagCached;
+    if (frame.frozenScore >= 100.0) slots[kSlotFlags] += kFlagFrozen;
+    if (options.alerts.enabled) {
+        slots[kSlotAlerts] = frame.alerts.active;
+        slots[kSlotAlertsChanged] = frame.alerts.changed;
+    }
+}
+
+// Helper function to list the names of the metrics selected by a bitmask
+Napi::Array metricNamesArray(Napi::Env env, uint32_t metrics) {
+    Napi::Array names = Napi::Array::New(env);
+    for (int i = 0; i < kMetricCount; i++) {
+        if (metrics & (1u << i)) names.Set(names.Length(), Napi::String::New(env, kMetricNames[i]));
+    }
+    return names;
+}
+
+// Helper function to add a session's alert state to a result object
+void setAlerts(Napi::Env env, Napi::Object& result, const AlertState& alerts) {
+    Napi::Object object = Napi::Object::New(env);
+    object.Set("active", metricNamesArray(env, alerts.active));
+    object.Set("changed", metricNamesArray(env, alerts.changed));
+    Napi::Object smoothed = Napi::Object::New(env);
+    for (int i = 0; i < kMetricCount; i++) {
+        if (!std::isnan(alerts.smoothed[i])) smoothed.Set(kMetricNames[i], Napi::Number::New(env, alerts.smoothed[i]));
+    }
+    object.Set("smoothed", smoothed);
+    result.Set("alerts", object);
+}
+
+// Helper function to convert a session frame to a result object
+Napi::Object sessionFrameToObject(Napi::Env env, const SessionFrame& frame, const SessionOptions& options) {
+    Napi::Object result = sabotageScoresToObject(env, frame.scores);
+    if (options.analysis.metrics & kMetricSceneChange) {
+        result.Set("sceneChangeScore", Napi::Number::New(env, frame.sceneChangeScore));
+    }
+    if (options.sampling.enabled) {
+        result.Set("reused", Napi::Boolean::New(env, frame.reused));
+        result.Set("changeScore", Napi::Number::New(env, frame.changeScore));
+    }
+    if (options.dedup.enabled) {
+        result.Set("cached", Napi::Boolean::New(env, frame.cached));
+        result.Set("frozenScore", Napi::Number::New(env, frame.frozenScore));
+    }
+    if (options.alerts.enabled) setAlerts(env, result, frame.alerts);
+    return result;
 }
 
 Napi::Object DetectSabotage(const Napi::CallbackInfo& info) {
@@ -84,104 +527,20 @@ Napi::Object DetectSabotage(const Napi::CallbackInfo& info) {
     cv::Mat gray;
 
     try {
-        if (info[0].IsString()) {
-            // Handle file path
-            std::string imagePath = info[0].As<Napi::String>().Utf8Value();
-            gray = cv::imread(imagePath, cv::IMREAD_GRAYSCALE);
-        } else if (info[0].IsBuffer()) {
-            // Handle buffer
-            Napi::Buffer<uint8_t> buffer = info[0].As<Napi::Buffer<uint8_t>>();
-            gray = readImageFromBuffer(buffer);
-        } else {
+        StageTimer total(Stage::Total);
+        ImageInput input;
+        if (!readImageInput(info[0], input)) {
             Napi::TypeError::New(env, "Expected string or buffer argument").ThrowAsJavaScriptException();
             return Napi::Object::New(env);
         }
+        gray = decodeImageInput(input);
 
         if (gray.empty()) {
             Napi::Error::New(env, "Failed to read image").ThrowAsJavaScriptException();
             return Napi::Object::New(env);
         }
 
-        // Calculate all scores
-        double defocusScore = calculateDefocusScore(gray);
-        double blackoutScore = calculateBlackoutScore(gray);
-        double flashScore = calculateFlashScore(gray);
-
-        // Calculate smear score
-        double smearScore = 0.0;
-
-        // Calculate global contrast and brightness
-        cv::Scalar meanIntensity, stddevIntensity;
-        cv::meanStdDev(gray, meanIntensity, stddevIntensity);
-        double brightness = meanIntensity[0];
-        double contrastScore = 100.0 - std::min(100.0, std::max(0.0, (stddevIntensity[0] / 10.0) * 100.0));
-
-        // Calculate edge density
-        cv::Mat edges;
-        cv::Canny(gray, edges, 50, 150);
-        double edgeDensity = cv::countNonZero(edges) / (double)(edges.rows * edges.cols);
-        double edgeScore = 100.0 - std::min(100.0, edgeDensity * 150.0);
-
-        // Calculate intensity histogram
-        cv::Mat hist;
-        int histSize = 256;
-        float range[] = {0, 256};
-        const float* histRange = {range};
-        cv::calcHist(&gray, 1, 0, cv::Mat(), hist, 1, &histSize, &histRange);
-
-        // Calculate percentage of different intensity ranges
-        double darkPixels = 0, midPixels = 0, brightPixels = 0;
-        for (int i = 0; i < 256; i++) {
-            if (i < 85) darkPixels += hist.at<float>(i);
-            else if (i < 170) midPixels += hist.at<float>(i);
-            else brightPixels += hist.at<float>(i);
-        }
-        double totalPixels = gray.rows * gray.cols;
-        double darkPercentage = (darkPixels / totalPixels) * 100.0;
-        double midPercentage = (midPixels / totalPixels) * 100.0;
-        double brightPercentage = (brightPixels / totalPixels) * 100.0;
-
-        // Calculate base characteristics score with adjusted weights
-        double baseScore = (defocusScore * 0.5) + (contrastScore * 0.3) + (edgeScore * 0.2);
-
-        // Calculate intensity distribution score with adjusted thresholds
-        double intensityScore = 0.0;
-        
-        // Adjust thresholds based on overall brightness
-        double brightnessFactor = std::min(1.0, brightness / 120.0);
-        double darkThreshold = 8.0 + (brightnessFactor * 3.0);
-        double brightThreshold = 8.0 + ((1.0 - brightnessFactor) * 3.0);
-        double midThreshold = 15.0 + (brightnessFactor * 2.0);
-
-        // Increase sensitivity to bright conditions
-        if (brightness > 120.0) {
-            intensityScore += (brightness - 120.0) * 0.8;
-        }
-
-        if (darkPercentage > darkThreshold) intensityScore += darkPercentage * 0.5;
-        if (brightPercentage > brightThreshold) intensityScore += brightPercentage * 0.5;
-        if (midPercentage > midThreshold) intensityScore += midPercentage * 0.3;
-
-        // Calculate combined score
-        double combinedScore = baseScore + (intensityScore * 0.4);
-
-        // Invert the scoring logic - higher scores for smears, lower for normal images
-        if (combinedScore > 20.0) { // Lower threshold to catch more smears
-            // Give high scores for smears
-            smearScore = std::min(100.0, 20.0 + (combinedScore - 20.0) * 1.5);
-        } else {
-            // Give low scores for normal images
-            smearScore = combinedScore * 0.5;
-        }
-
-        // Create result object
-        Napi::Object result = Napi::Object::New(env);
-        result.Set("defocusScore", Napi::Number::New(env, defocusScore));
-        result.Set("blackoutScore", Napi::Number::New(env, blackoutScore));
-        result.Set("flashScore", Napi::Number::New(env, flashScore));
-        result.Set("smearScore", Napi::Number::New(env, smearScore));
-
-        return result;
+        return sabotageScoresToObject(env, computeSabotageScores(gray, AnalysisOptions()));
     }
     catch (const std::exception& e) {
         Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
@@ -194,29 +553,18 @@ Napi::Object DetectSceneChange(const Napi::CallbackInfo& info) {
     cv::Mat current, previous;
 
     try {
-        // Handle current frame
-        if (info[0].IsString()) {
-            std::string currentImagePath = info[0].As<Napi::String>().Utf8Value();
-            current = cv::imread(currentImagePath, cv::IMREAD_GRAYSCALE);
-        } else if (info[0].IsBuffer()) {
-            Napi::Buffer<uint8_t> buffer = info[0].As<Napi::Buffer<uint8_t>>();
-            current = readImageFromBuffer(buffer);
-        } else {
+        StageTimer total(Stage::Total);
+        ImageInput currentInput, previousInput;
+        if (!readImageInput(info[0], currentInput)) {
             Napi::TypeError::New(env, "Expected string or buffer argument for current frame").ThrowAsJavaScriptException();
             return Napi::Object::New(env);
         }
-
-        // Handle previous frame
-        if (info[1].IsString()) {
-            std::string previousImagePath = info[1].As<Napi::String>().Utf8Value();
-            previous = cv::imread(previousImagePath, cv::IMREAD_GRAYSCALE);
-        } else if (info[1].IsBuffer()) {
-            Napi::Buffer<uint8_t> buffer = info[1].As<Napi::Buffer<uint8_t>>();
-            previous = readImageFromBuffer(buffer);
-        } else {
+        if (!readImageInput(info[1], previousInput)) {
             Napi::TypeError::New(env, "Expected string or buffer argument for previous frame").ThrowAsJavaScriptException();
             return Napi::Object::New(env);
         }
+        current = decodeImageInput(currentInput);
+        previous = decodeImageInput(previousInput);
 
         if (current.empty() || previous.empty()) {
             Napi::Error::New(env, "Failed to read images").ThrowAsJavaScriptException();
@@ -237,116 +585,1134 @@ Napi::Object DetectSceneChange(const Napi::CallbackInfo& info) {
 
 Napi::Object DetectSmear(const Napi::CallbackInfo& info) {
     Napi::Env env = info.Env();
+    cv::Mat gray;
+
+    try {
+        StageTimer total(Stage::Total);
+        ImageInput input;
+        if (!readImageInput(info[0], input)) {
+            Napi::TypeError::New(env, "Expected string or buffer argument").ThrowAsJavaScriptException();
+            return Napi::Object::New(env);
+        }
+        gray = decodeImageInput(input);
+
+        if (gray.empty()) {
+            Napi::Error::New(env, "Failed to read image").ThrowAsJavaScriptException();
+            return Napi::Object::New(env);
+        }
+
+        return sabotageScoresToObject(env, computeSabotageScores(gray, smearOnlyOptions(AnalysisOptions())));
+    }
+    catch (const std::exception& e) {
+        Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
+        return Napi::Object::New(env);
+    }
+}
+
+// Async worker that decodes and scores a frame on the libuv threadpool
+class DetectSabotageWorker : public Napi::AsyncWorker {
+public:
+    DetectSabotageWorker(Napi::Env env, ImageInput input, AnalysisOptions options)
+        : Napi::AsyncWorker(env),
+          deferred_(Napi::Promise::Deferred::New(env)),
+          input_(std::move(input)),
+          options_(options) {}
+
+    Napi::Promise GetPromise() { return deferred_.Promise(); }
+
+protected:
+    void Execute() override {
+        TimingScope timing(options_.timings ? &timings_ : nullptr);
+        StageTimer total(Stage::Total);
+        try {
+            cv::Mat gray = decodeImageInput(input_, options_.analysisScale);
+            if (gray.empty()) {
+                SetError("Failed to read image");
+                return;
+            }
+            scores_ = computeSabotageScores(gray, options_);
+        }
+        catch (const std::exception& e) {
+            SetError(e.what());
+        }
+    }
+
+    void OnOK() override {
+        Napi::Object result = sabotageScoresToObject(Env(), scores_);
+        if (options_.timings) setTimings(Env(), result, timings_);
+        deferred_.Resolve(result);
+    }
+
+    void OnError(const Napi::Error& error) override {
+        deferred_.Reject(error.Value());
+    }
+
+private:
+    Napi::Promise::Deferred deferred_;
+    ImageInput input_;
+    AnalysisOptions options_;
+    SabotageScores scores_;
+    StageTimings timings_;
+};
+
+// Async worker that decodes two frames and compares them on the libuv threadpool
+class DetectSceneChangeWorker : public Napi::AsyncWorker {
+public:
+    DetectSceneChangeWorker(Napi::Env env, ImageInput current, ImageInput previous, AnalysisOptions options)
+        : Napi::AsyncWorker(env),
+          deferred_(Napi::Promise::Deferred::New(env)),
+          current_(std::move(current)),
+          previous_(std::move(previous)),
+          options_(options) {}
+
+    Napi::Promise GetPromise() { return deferred_.Promise(); }
+
+protected:
+    void Execute() override {
+        TimingScope timing(options_.timings ? &timings_ : nullptr);
+        StageTimer total(Stage::Total);
+        try {
+            cv::Mat current = decodeImageInput(current_, options_.analysisScale);
+            cv::Mat previous = decodeImageInput(previous_, options_.analysisScale);
+            if (current.empty() || previous.empty()) {
+                SetError("Failed to read images");
+                return;
+            }
+            sceneChangeScore_ =
+                calculateSceneChangeScore(current, previous, options_.resolveMask(current), options_.backend);
+        }
+        catch (const std::exception& e) {
+            SetError(e.what());
+        }
+    }
+
+    void OnOK() override {
+        Napi::Env env = Env();
+        Napi::Object result = Napi::Object::New(env);
+        result.Set("sceneChangeScore", Napi::Number::New(env, sceneChangeScore_));
+        if (options_.timings) setTimings(env, result, timings_);
+        deferred_.Resolve(result);
+    }
+
+    void OnError(const Napi::Error& error) override {
+        deferred_.Reject(error.Value());
+    }
+
+private:
+    Napi::Promise::Deferred deferred_;
+    ImageInput current_;
+    ImageInput previous_;
+    AnalysisOptions options_;
+    double sceneChangeScore_ = 0.0;
+    StageTimings timings_;
+};
+
+// Helper function to create a promise that is already rejected with a TypeError
+Napi::Promise rejectedPromise(Napi::Env env, const std::string& message) {
+    Napi::Promise::Deferred deferred = Napi::Promise::Deferred::New(env);
+    deferred.Reject(Napi::TypeError::New(env, message).Value());
+    return deferred.Promise();
+}
+
+Napi::Value DetectSabotageAsync(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    ImageInput input;
+    if (!readImageInput(info[0], input)) {
+        return rejectedPromise(env, "Expected string or buffer argument");
+    }
+    AnalysisOptions options;
+    std::string error = readAnalysisOptions(info[1], options);
+    if (!error.empty()) {
+        return rejectedPromise(env, error);
+    }
+
+    DetectSabotageWorker* worker = new DetectSabotageWorker(env, std::move(input), options);
+    Napi::Promise promise = worker->GetPromise();
+    worker->Queue();
+    return promise;
+}
+
+Napi::Value DetectSabotageRawAsync(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    ImageInput input;
+    AnalysisOptions options;
+    std::string error = readRawImageInput(info[0], info[1], input);
+    if (error.empty()) {
+        error = readAnalysisOptions(info[2], options);
+    }
+    if (!error.empty()) {
+        return rejectedPromise(env, error);
+    }
+
+    DetectSabotageWorker* worker = new DetectSabotageWorker(env, std::move(input), options);
+    Napi::Promise promise = worker->GetPromise();
+    worker->Queue();
+    return promise;
+}
+
+Napi::Value DetectSceneChangeAsync(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    ImageInput current, previous;
+    if (!readImageInput(info[0], current)) {
+        return rejectedPromise(env, "Expected string or buffer argument for current frame");
+    }
+    if (!readImageInput(info[1], previous)) {
+        return rejectedPromise(env, "Expected string or buffer argument for previous frame");
+    }
+    AnalysisOptions options;
+    std::string error = readAnalysisOptions(info[2], options);
+    if (!error.empty()) {
+        return rejectedPromise(env, error);
+    }
+
+    DetectSceneChangeWorker* worker = new DetectSceneChangeWorker(env, std::move(current), std::move(previous), options);
+    Napi::Promise promise = worker->GetPromise();
+    worker->Queue();
+    return promise;
+}
+
+Napi::Value DetectSmearAsync(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    ImageInput input;
+    if (!readImageInput(info[0], input)) {
+        return rejectedPromise(env, "Expected string or buffer argument");
+    }
+    AnalysisOptions options;
+    std::string error = readAnalysisOptions(info[1], options);
+    if (!error.empty()) {
+        return rejectedPromise(env, error);
+    }
+
+    DetectSabotageWorker* worker = new DetectSabotageWorker(env, std::move(input), smearOnlyOptions(options));
+    Napi::Promise promise = worker->GetPromise();
+    worker->Queue();
+    return promise;
+}
+
+// Async worker that decodes and scores a batch of frames across the shared thread pool
+class DetectSabotageBatchWorker : public Napi::AsyncWorker {
+public:
+    DetectSabotageBatchWorker(Napi::Env env, std::vector<ImageInput> inputs, AnalysisOptions options,
+                              ResultOutput output)
+        : Napi::AsyncWorker(env),
+          deferred_(Napi::Promise::Deferred::New(env)),
+          inputs_(std::move(inputs)),
+          options_(options),
+          output_(std::move(output)),
+          scores_(inputs_.size()),
+          errors_(inputs_.size()),
+          timings_(options.timings ? inputs_.size() : 0) {}
+
+    Napi::Promise GetPromise() { return deferred_.Promise(); }
+
+protected:
+    void Execute() override {
+        std::shared_ptr<ThreadPool> pool = sharedThreadPool();
+        FrameLevelScope frameLevel;
+        pool->parallelFor(inputs_.size(), [this](size_t i) {
+            TimingScope timing(options_.timings ? &timings_[i] : nullptr);
+            StageTimer total(Stage::Total);
+            try {
+                cv::Mat gray = decodeImageInput(inputs_[i], options_.analysisScale);
+                if (gray.empty()) {
+                    errors_[i] = "Failed to read image";
+                } else {
+                    scores_[i] = computeSabotageScores(gray, options_);
+                }
+            }
+            catch (const std::exception& e) {
+                errors_[i] = e.what();
+            }
+            if (output_.enabled()) {
+                double nan = std::numeric_limits<double>::quiet_NaN();
+                writeResultSlots(output_.slots(i), errors_[i].empty() ? &scores_[i] : nullptr, nan);
+            }
+        });
+    }
+
+    void OnOK() override {
+        Napi::Env env = Env();
+        if (output_.enabled()) {
+            deferred_.Resolve(output_.arrayRef.Value());
+            return;
+        }
+        Napi::Array results = Napi::Array::New(env, inputs_.size());
+        for (size_t i = 0; i < inputs_.size(); i++) {
+            if (errors_[i].empty()) {
+                Napi::Object result = sabotageScoresToObject(env, scores_[i]);
+                if (options_.timings) setTimings(env, result, timings_[i]);
+                results.Set(static_cast<uint32_t>(i), result);
+            } else {
+                Napi::Object failure = Napi::Object::New(env);
+                failure.Set("error", Napi::String::New(env, errors_[i]));
+                results.Set(static_cast<uint32_t>(i), failure);
+            }
+        }
+        deferred_.Resolve(results);
+    }
+
+    void OnError(const Napi::Error& error) override {
+        deferred_.Reject(error.Value());
+    }
+
+private:
+    Napi::Promise::Deferred deferred_;
+    std::vector<ImageInput> inputs_;
+    AnalysisOptions options_;
+    ResultOutput output_;
+    std::vector<SabotageScores> scores_;
+    std::vector<std::string> errors_;
+    std::vector<StageTimings> timings_;  // Per frame, only with options.timings
+};
+
+Napi::Value DetectSabotageBatchAsync(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    if (!info[0].IsArray()) {
+        return rejectedPromise(env, "Expected an array of frames");
+    }
+    Napi::Array frames = info[0].As<Napi::Array>();
+
+    std::vector<ImageInput> inputs(frames.Length());
+    for (uint32_t i = 0; i < frames.Length(); i++) {
+        Napi::Value frame = frames.Get(i);
+        std::string error;
+        if (frame.IsObject() && !frame.IsBuffer()) {
+            // Raw frames are passed as {data, width, height, stride, format}
+            error = readRawImageInput(frame.As<Napi::Object>().Get("data"), frame, inputs[i]);
+        } else if (!readImageInput(frame, inputs[i])) {
+            error = "Expected string, buffer or raw frame";
+        }
+        if (!error.empty()) {
+            return rejectedPromise(env, "Frame " + std::to_string(i) + ": " + error);
+        }
+    }
+
+    AnalysisOptions options;
+    ResultOutput output;
+    std::string error = readAnalysisOptions(info[1], options);
+    if (error.empty() && info[1].IsObject()) {
+        error = readResultOutput(info[1].As<Napi::Object>().Get("output"), inputs.size(), output);
+    }
+    if (error.empty() && output.enabled() && options.timings) {
+        // Float64Array slots have no room for timings, which would be collected and dropped
+        error = "timings cannot be combined with output";
+    }
+    if (!error.empty()) {
+        return rejectedPromise(env, error);
+    }
+
+    DetectSabotageBatchWorker* worker =
+        new DetectSabotageBatchWorker(env, std::move(inputs), options, std::move(output));
+    Napi::Promise promise = worker->GetPromise();
+    worker->Queue();
+    return promise;
+}
+
+// Helper function to read the alerts option of a session: true for the defaults, or
+// {alpha, window, required, hysteresis, thresholds: {metric: score}}.
+// Returns an error message, or an empty string on success.
+std::string readAlertOptions(const Napi::Value& value, AlertOptions& options) {
+    if (value.IsBoolean()) {
+        options.enabled = value.As<Napi::Boolean>().Value();
+        return "";
+    }
+    if (!value.IsObject()) {
+        return "alerts must be a boolean or an object";
+    }
+    Napi::Object object = value.As<Napi::Object>();
+    options.enabled = true;
+
+    Napi::Value alpha = object.Get("alpha");
+    if (!alpha.IsUndefined()) {
+        double number = alpha.IsNumber() ? alpha.As<Napi::Number>().DoubleValue() : 0.0;
+        if (!(number > 0.0 && number <= 1.0)) {
+            return "alerts.alpha must be in (0, 1]";
+        }
+        options.alpha = number;
+    }
+
+    Napi::Value window = object.Get("window");
+    if (!window.IsUndefined()) {
+        double number = window.IsNumber() ? window.As<Napi::Number>().DoubleValue() : 0.0;
+        if (!(number >= 1.0 && number <= 32.0) || number != std::floor(number)) {
+            return "alerts.window must be an integer between 1 and 32";
+        }
+        options.window = static_cast<int>(number);
+        options.required = std::min(options.required, options.window);
+    }
+
+    Napi::Value required = object.Get("required");
+    if (!required.IsUndefined()) {
+        double number = required.IsNumber() ? required.As<Napi::Number>().DoubleValue() : 0.0;
+        if (!(number >= 1.0 && number <= options.window) || number != std::floor(number)) {
+            return "alerts.required must be an integer between 1 and alerts.window";
+        }
+        options.required = static_cast<int>(number);
+    }
+
+    Napi::Value hysteresis = object.Get("hysteresis");
+    if (!hysteresis.IsUndefined()) {
+        double number = hysteresis.IsNumber() ? hysteresis.As<Napi::Number>().DoubleValue() : -1.0;
+        if (!(number >= 0.0 && number <= 100.0)) {
+            return "alerts.hysteresis must be between 0 and 100";
+        }
+        options.hysteresis = number;
+    }
+
+    Napi::Value thresholds = object.Get("thresholds");
+    if (!thresholds.IsUndefined()) {
+        if (!thresholds.IsObject()) {
+            return "alerts.thresholds must be an object of metric names to scores";
+        }
+        Napi::Object map = thresholds.As<Napi::Object>();
+        for (int i = 0; i < kMetricCount; i++) {
+            Napi::Value threshold = map.Get(kMetricNames[i]);
+            if (threshold.IsUndefined()) continue;
+            double number = threshold.IsNumber() ? threshold.As<Napi::Number>().DoubleValue() : -1.0;
+            if (!(number >= 0.0 && number <= 100.0)) {
+                return std::string("alerts.thresholds.") + kMetricNames[i] + " must be between 0 and 100";
+            }
+            options.thresholds[i] = number;
+        }
+    }
+    return "";
+}
+
+// Helper function to read the sampling option of a session: true for the defaults, or
+// {changeThreshold, maxInterval}. Returns an error message, or an empty string on success.
+std::string readSamplingOptions(const Napi::Value& value, SamplingOptions& options) {
+    if (value.IsBoolean()) {
+        options.enabled = value.As<Napi::Boolean>().Value();
+        return "";
+    }
+    if (!value.IsObject()) {
+        return "sampling must be a boolean or an object";
+    }
+    Napi::Object object = value.As<Napi::Object>();
+    options.enabled = true;
+
+    Napi::Value threshold = object.Get("changeThreshold");
+    if (!threshold.IsUndefined()) {
+        double number = threshold.IsNumber() ? threshold.As<Napi::Number>().DoubleValue() : -1.0;
+        if (!(number >= 0.0 && number <= 100.0)) {
+            return "sampling.changeThreshold must be between 0 and 100";
+        }
+        options.changeThreshold = number;
+    }
+
+    Napi::Value interval = object.Get("maxInterval");
+    if (!interval.IsUndefined()) {
+        double number = interval.IsNumber() ? interval.As<Napi::Number>().DoubleValue() : 0.0;
+        if (!(number >= 1.0 && number <= 1024.0) || number != std::floor(number)) {
+            return "sampling.maxInterval must be an integer between 1 and 1024";
+        }
+        options.maxInterval = static_cast<int>(number);
+    }
+    return "";
+}
+
+// Helper function to read the dedup option of a session: true for the defaults, or
+// {maxDistance, cacheSize, frozenFrames, brightnessBits}. Returns an error message, or an empty string on success.
+std::string readDedupOptions(const Napi::Value& value, DedupOptions& options) {
+    if (value.IsBoolean()) {
+        options.enabled = value.As<Napi::Boolean>().Value();
+        return "";
+    }
+    if (!value.IsObject()) {
+        return "dedup must be a boolean or an object";
+    }
+    Napi::Object object = value.As<Napi::Object>();
+    options.enabled = true;
+
+    auto readInteger = [&](const char* name, int min, int max, int& target) {
+        Napi::Value property = object.Get(name);
+        if (property.IsUndefined()) return std::string();
+        double number = property.IsNumber() ? property.As<Napi::Number>().DoubleValue() : -1.0;
+        if (!(number >= min && number <= max) || number != std::floor(number)) {
+            return std::string("dedup.") + name + " must be an integer between " + std::to_string(min) +
+                   " and " + std::to_string(max);
+        }
+        target = static_cast<int>(number);
+        return std::string();
+    };
+    std::string error = readInteger("maxDistance", 0, 64, options.maxDistance);
+    if (error.empty()) error = readInteger("cacheSize", 1, 1024, options.cacheSize);
+    if (error.empty()) error = readInteger("frozenFrames", 1, 1000000, options.frozenFrames);
+    if (error.empty()) error = readInteger("brightnessBits", 0, 8, options.brightnessBits);
+    return error;
+}
+
+// Helper function to read CameraSession options; undefined selects the defaults.
+// Returns an error message, or an empty string on success.
+std::string readSessionOptions(const Napi::Value& value, SessionOptions& options) {
+    std::string error = readAnalysisOptions(value, options.analysis);
+    if (!error.empty() || value.IsUndefined() || value.IsNull()) return error;
+    Napi::Object object = value.As<Napi::Object>();
+
+    Napi::Value mode = object.Get("sceneChangeMode");
+    if (!mode.IsUndefined()) {
+        std::string name = mode.IsString() ? mode.As<Napi::String>().Utf8Value() : "";
+        if (name == "background") {
+            options.sceneChangeMode = SceneChangeMode::Background;
+        } else if (name == "previous") {
+            options.sceneChangeMode = SceneChangeMode::Previous;
+        } else {
+            return "sceneChangeMode must be 'background' or 'previous'";
+        }
+    }
+
+    Napi::Value alpha = object.Get("backgroundAlpha");
+    if (!alpha.IsUndefined()) {
+        double number = alpha.IsNumber() ? alpha.As<Napi::Number>().DoubleValue() : 0.0;
+        if (!(number > 0.0 && number <= 1.0)) {
+            return "backgroundAlpha must be in (0, 1]";
+        }
+        options.backgroundAlpha = number;
+    }
+
+    Napi::Value scale = object.Get("backgroundScale");
+    if (!scale.IsUndefined()) {
+        double number = scale.IsNumber() ? scale.As<Napi::Number>().DoubleValue() : 0.0;
+        if (!(number >= 1.0 && number <= 64.0) || number != std::floor(number)) {
+            return "backgroundScale must be an integer between 1 and 64";
+        }
+        options.backgroundScale = static_cast<int>(number);
+    }
+
+    Napi::Value alerts = object.Get("alerts");
+    if (!alerts.IsUndefined()) {
+        error = readAlertOptions(alerts, options.alerts);
+        if (!error.empty()) return error;
+    }
+
+    Napi::Value sampling = object.Get("sampling");
+    if (!sampling.IsUndefined()) {
+        error = readSamplingOptions(sampling, options.sampling);
+        if (!error.empty()) return error;
+    }
+
+    Napi::Value dedup = object.Get("dedup");
+    if (!dedup.IsUndefined()) {
+        error = readDedupOptions(dedup, options.dedup);
+        if (!error.empty()) return error;
+    }
+    return "";
+}
+
+// JS handle of a SessionScorer
+class CameraSession : public Napi::ObjectWrap<CameraSession> {
+public:
+    static Napi::Function Init(Napi::Env env) {
+        return DefineClass(env, "CameraSession", {
+            InstanceMethod("process", &CameraSession::Process),
+            InstanceMethod("processRaw", &CameraSession::ProcessRaw),
+            InstanceMethod("reset", &CameraSession::Reset),
+        });
+    }
+
+    CameraSession(const Napi::CallbackInfo& info) : Napi::ObjectWrap<CameraSession>(info) {
+        SessionOptions options;
+        std::string error = readSessionOptions(info[0], options);
+        if (!error.empty()) {
+            Napi::TypeError::New(info.Env(), error).ThrowAsJavaScriptException();
+            return;
+        }
+        scorer_.reset(new SessionScorer(options));
+    }
+
+    SessionScorer& scorer() { return *scorer_; }
+    const AnalysisOptions& options() const { return scorer_->options().analysis; }
+    const SessionOptions& sessionOptions() const { return scorer_->options(); }
+
+private:
+    Napi::Value Process(const Napi::CallbackInfo& info);
+    Napi::Value ProcessRaw(const Napi::CallbackInfo& info);
+
+    Napi::Value Reset(const Napi::CallbackInfo& info) {
+        scorer_->reset();
+        return info.Env().Undefined();
+    }
+
+    std::unique_ptr<SessionScorer> scorer_;
+};
+
+// Async worker that decodes a frame and runs it through a CameraSession
+class SessionProcessWorker : public Napi::AsyncWorker {
+public:
+    SessionProcessWorker(Napi::Env env, CameraSession* session, ImageInput input, ResultOutput output)
+        : Napi::AsyncWorker(env),
+          deferred_(Napi::Promise::Deferred::New(env)),
+          session_(session),
+          sessionRef_(Napi::Persistent(session->Value())),
+          input_(std::move(input)),
+          output_(std::move(output)) {}
+
+    Napi::Promise GetPromise() { return deferred_.Promise(); }
+
+protected:
+    void Execute() override {
+        // Float64Array slots have no room for timings, so they are not collected for them
+        bool withTimings = session_->options().timings && !output_.enabled();
+        TimingScope timing(withTimings ? &timings_ : nullptr);
+        StageTimer total(Stage::Total);
+        try {
+            cv::Mat gray = decodeImageInput(input_, session_->options().analysisScale);
+            if (gray.empty()) {
+                SetError("Failed to read image");
+                return;
+            }
+            // Raw frames may be wrapped in place; the session must own what it keeps
+            if (session_->scorer().keepsPreviousFrame() &&
+                gray.data >= input_.data && gray.data < input_.data + input_.length) {
+                gray = gray.clone();
+            }
+            frame_ = session_->scorer().analyze(gray);
+            if (output_.enabled()) {
+                writeSessionSlots(output_.slots(0), frame_, session_->sessionOptions());
+            }
+        }
+        catch (const std::exception& e) {
+            SetError(e.what());
+        }
+    }
+
+    void OnOK() override {
+        Napi::Env env = Env();
+        if (output_.enabled()) {
+            deferred_.Resolve(output_.arrayRef.Value());
+            return;
+        }
+        Napi::Object result = sessionFrameToObject(env, frame_, session_->sessionOptions());
+        if (session_->options().timings) setTimings(env, result, timings_);
+        deferred_.Resolve(result);
+    }
+
+    void OnError(const Napi::Error& error) override {
+        deferred_.Reject(error.Value());
+    }
+
+private:
+    Napi::Promise::Deferred deferred_;
+    CameraSession* session_;
+    Napi::ObjectReference sessionRef_;  // Keeps the session alive while the worker runs
+    ImageInput input_;
+    ResultOutput output_;
+    SessionFrame frame_;
+    StageTimings timings_;
+};
+
+Napi::Value CameraSession::Process(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    ImageInput input;
+    if (!readImageInput(info[0], input)) {
+        return rejectedPromise(env, "Expected string or buffer argument");
+    }
+    ResultOutput output;
+    std::string error = readResultOutput(info[1], 1, output);
+    if (!error.empty()) {
+        return rejectedPromise(env, error);
+    }
+
+    SessionProcessWorker* worker = new SessionProcessWorker(env, this, std::move(input), std::move(output));
+    Napi::Promise promise = worker->GetPromise();
+    worker->Queue();
+    return promise;
+}
+
+Napi::Value CameraSession::ProcessRaw(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    ImageInput input;
+    ResultOutput output;
+    std::string error = readRawImageInput(info[0], info[1], input);
+    if (error.empty()) {
+        error = readResultOutput(info[2], 1, output);
+    }
+    if (!error.empty()) {
+        return rejectedPromise(env, error);
+    }
+
+    SessionProcessWorker* worker = new SessionProcessWorker(env, this, std::move(input), std::move(output));
+    Napi::Promise promise = worker->GetPromise();
+    worker->Queue();
+    return promise;
+}
+
+// State of a file job shared by its worker and the thread-safe function streaming its
+// results. Streamed results may still be queued when the worker completes, so the promise is
+// settled by whichever finishes last: the worker itself without a callback, otherwise the
+// finalizer of the thread-safe function.
+struct FileJobState {
+    explicit FileJobState(Napi::Env env) : deferred(Napi::Promise::Deferred::New(env)) {}
+
+    void settle(Napi::Env env) {
+        if (!error.empty()) {
+            deferred.Reject(Napi::Error::New(env, error).Value());
+        } else {
+            Napi::Object result = Napi::Object::New(env);
+            result.Set("processed", Napi::Number::New(env, static_cast<double>(summary.processed)));
+            result.Set("failed", Napi::Number::New(env, static_cast<double>(summary.failed)));
+            result.Set("elapsedMs", Napi::Number::New(env, summary.elapsedMs));
+            result.Set("cancelled", Napi::Boolean::New(env, summary.cancelled));
+            deferred.Resolve(result);
+        }
+        delete this;
+    }
+
+    Napi::Promise::Deferred deferred;
+    std::vector<std::string> paths;
+    FileJobSummary summary;
+    std::string error;
+};
+
+// Async worker that runs a file job. Results go to an NDJSON file and/or to a JS callback
+// through a thread-safe function; decoder threads block while kMaxQueuedResults results are
+// waiting, so a slow callback holds the job back instead of piling results up.
+class ProcessFilesWorker : public Napi::AsyncWorker {
+public:
+    static const size_t kMaxQueuedResults = 64;
+
+    ProcessFilesWorker(Napi::Env env, std::vector<std::string> paths, FileJobOptions options,
+                       std::string outputPath, Napi::Value callback)
+        : Napi::AsyncWorker(env),
+          state_(new FileJobState(env)),
+          options_(std::move(options)),
+          outputPath_(std::move(outputPath)),
+          cancel_(std::make_shared<std::atomic<bool>>(false)) {
+        state_->paths = std::move(paths);
+        if (callback.IsFunction()) {
+            FileJobState* state = state_;
+            results_ = Napi::ThreadSafeFunction::New(env, callback.As<Napi::Function>(), "processFiles",
+                                                     kMaxQueuedResults, 1, [state](Napi::Env env) { state->settle(env); });
+            streaming_ = true;
+        }
+    }
+
+    Napi::Promise GetPromise() { return state_->deferred.Promise(); }
+
+    // Function that stops the job after the files in progress. It only holds the flag, so it
+    // stays safe to call after the job has finished.
+    Napi::Function GetCancel(Napi::Env env) {
+        std::shared_ptr<std::atomic<bool>> cancel = cancel_;
+        return Napi::Function::New(env, [cancel](const Napi::CallbackInfo& info) {
+            cancel->store(true);
+            return info.Env().Undefined();
+        }, "cancel");
+    }
+
+protected:
+    void Execute() override {
+        try {
+            NdjsonWriter writer;
+            bool writing = !outputPath_.empty();
+            if (writing) {
+                std::string error = writer.open(outputPath_);
+                if (!error.empty()) {
+                    SetError(error);
+                    return;
+                }
+            }
+            FileJobState* state = state_;
+            bool timings = options_.analysis.timings;
+            state_->summary = processFiles(state_->paths, options_, [&](FileResult&& result) {
+                if (writing) writer.write(result, state->paths[result.index]);
+                if (!streaming_) return;
+                FileResult* owned = new FileResult(std::move(result));
+                napi_status status = results_.BlockingCall(owned, [state, timings](Napi::Env env, Napi::Function callback,
+                                                                                   FileResult* result) {
+                    std::unique_ptr<FileResult> guard(result);
+                    Napi::Object object = result->error.empty() ? sabotageScoresToObject(env, result->scores)
+                                                                : Napi::Object::New(env);
+                    object.Set("index", Napi::Number::New(env, static_cast<double>(result->index)));
+                    object.Set("path", Napi::String::New(env, state->paths[result->index]));
+                    if (!result->error.empty()) {
+                        object.Set("error", Napi::String::New(env, result->error));
+                    } else if (timings) {
+                        setTimings(env, object, result->timings);
+                    }
+                    callback.Call({object});
+                });
+                if (status != napi_ok) delete owned;
+            }, cancel_.get());
+            if (writing && !writer.close()) {
+                SetError("Failed to write " + outputPath_);
+            }
+        }
+        catch (const std::exception& e) {
+            SetError(e.what());
+        }
+    }
+
+    void OnOK() override {
+        finish();
+    }
+
+    void OnError(const Napi::Error& error) override {
+        state_->error = error.Message();
+        finish();
+    }
+
+private:
+    void finish() {
+        if (streaming_) {
+            results_.Release();  // The finalizer settles the promise after the last result
+        } else {
+            state_->settle(Env());
+        }
+    }
+
+    FileJobState* state_;
+    FileJobOptions options_;
+    std::string outputPath_;
+    Napi::ThreadSafeFunction results_;
+    bool streaming_ = false;
+    std::shared_ptr<std::atomic<bool>> cancel_;
+};
+
+// processFiles(paths, options, onResult) scores image files with the file job pipeline and
+// returns {promise, cancel}. Options are the analysis options plus prefetch, decoders and
+// output (an NDJSON path).
+Napi::Value ProcessFiles(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    // Invalid arguments still return a job, one whose promise is already rejected
+    auto rejectedJob = [&env](const std::string& message) {
+        Napi::Object job = Napi::Object::New(env);
+        job.Set("promise", rejectedPromise(env, message));
+        return job;
+    };
+
+    if (!info[0].IsArray()) {
+        return rejectedJob("Expected an array of file paths");
+    }
+    Napi::Array list = info[0].As<Napi::Array>();
+    std::vector<std::string> paths(list.Length());
+    for (uint32_t i = 0; i < list.Length(); i++) {
+        Napi::Value path = list.Get(i);
+        if (!path.IsString()) {
+            return rejectedJob("File " + std::to_string(i) + ": expected a path string");
+        }
+        paths[i] = path.As<Napi::String>().Utf8Value();
+    }
+
+    FileJobOptions options;
+    std::string outputPath;
+    std::string error = readAnalysisOptions(info[1], options.analysis);
+    if (error.empty() && info[1].IsObject()) {
+        Napi::Object object = info[1].As<Napi::Object>();
+        auto readCount = [&](const char* name, double max, size_t& target) {
+            Napi::Value property = object.Get(name);
+            if (property.IsUndefined()) return std::string();
+            double number = property.IsNumber() ? property.As<Napi::Number>().DoubleValue() : 0.0;
+            if (!(number >= 1.0 && number <= max) || number != std::floor(number)) {
+                return std::string(name) + " must be an integer between 1 and " + std::to_string(static_cast<int>(max));
+            }
+            target = static_cast<size_t>(number);
+            return std::string();
+        };
+        error = readCount("prefetch", 4096.0, options.prefetch);
+        if (error.empty()) error = readCount("decoders", 256.0, options.decoders);
+        Napi::Value output = object.Get("output");
+        if (error.empty() && !output.IsUndefined()) {
+            if (!output.IsString() || output.As<Napi::String>().Utf8Value().empty()) {
+                error = "output must be a file path";
+            } else {
+                outputPath = output.As<Napi::String>().Utf8Value();
+            }
+        }
+    }
+    if (!error.empty()) {
+        return rejectedJob(error);
+    }
+    if (!info[2].IsUndefined() && !info[2].IsFunction()) {
+        return rejectedJob("onResult must be a function");
+    }
+
+    ProcessFilesWorker* worker =
+        new ProcessFilesWorker(env, std::move(paths), std::move(options), std::move(outputPath), info[2]);
+    Napi::Object job = Napi::Object::New(env);
+    job.Set("promise", worker->GetPromise());
+    job.Set("cancel", worker->GetCancel(env));
+    worker->Queue();
+    return job;
+}
+
+#ifdef SABOTAGE_WITH_VIDEOIO
+// Helper function to read VideoSource options: the CameraSession options plus fps.
+// Returns an error message, or an empty string on success.
+std::string readStreamOptions(const Napi::Value& value, StreamOptions& options) {
+    std::string error = readSessionOptions(value, options.session);
+    if (!error.empty() || value.IsUndefined() || value.IsNull()) return error;
+
+    Napi::Value fps = value.As<Napi::Object>().Get("fps");
+    if (!fps.IsUndefined()) {
+        double number = fps.IsNumber() ? fps.As<Napi::Number>().DoubleValue() : 0.0;
+        if (!(number > 0.0 && number <= 1000.0)) {
+            return "fps must be greater than 0 and at most 1000";
+        }
+        options.fps = number;
+    }
+    return "";
+}
+
+// Native stream source: a StreamReader whose events reach a JS callback through a
+// thread-safe function. At most kMaxQueuedEvents results wait for the event loop; later
+// ones are dropped (and counted) so a busy event loop cannot make the reader fall behind
+// a live stream. The object keeps itself alive from start() until the end event.
+class VideoSource : public Napi::ObjectWrap<VideoSource> {
+public:
+    static Napi::Function Init(Napi::Env env) {
+        return DefineClass(env, "VideoSource", {
+            InstanceMethod("start", &VideoSource::Start),
+            InstanceMethod("stop", &VideoSource::Stop),
+        });
+    }
+
+    VideoSource(const Napi::CallbackInfo& info) : Napi::ObjectWrap<VideoSource>(info) {
+        Napi::Env env = info.Env();
+        if (!info[0].IsString()) {
+            Napi::TypeError::New(env, "Expected a stream URL or file path").ThrowAsJavaScriptException();
+            return;
+        }
+        if (!info[2].IsFunction()) {
+            Napi::TypeError::New(env, "Expected an event callback").ThrowAsJavaScriptException();
+            return;
+        }
+        std::string error = readStreamOptions(info[1], options_);
+        if (!error.empty()) {
+            Napi::TypeError::New(env, error).ThrowAsJavaScriptException();
+            return;
+        }
+        url_ = info[0].As<Napi::String>().Utf8Value();
+        callback_ = Napi::Persistent(info[2].As<Napi::Function>());
+    }
+
+private:
+    static const size_t kMaxQueuedEvents = 16;
+
+    Napi::Value Start(const Napi::CallbackInfo& info) {
+        Napi::Env env = info.Env();
+        if (reader_) {
+            Napi::Error::New(env, "VideoSource was already started").ThrowAsJavaScriptException();
+            return env.Undefined();
+        }
+        events_ = Napi::ThreadSafeFunction::New(env, callback_.Value(), "VideoSource", kMaxQueuedEvents, 1);
+        Ref();
+        reader_.reset(new StreamReader(url_, options_, [this](StreamEvent&& event) { deliver(std::move(event)); }));
+        reader_->start();
+        return env.Undefined();
+    }
+
+    Napi::Value Stop(const Napi::CallbackInfo& info) {
+        if (reader_) reader_->requestStop();
+        return info.Env().Undefined();
+    }
+
+    // Runs on the reader thread
+    void deliver(StreamEvent&& event) {
+        bool end = event.kind == StreamEvent::Kind::End;
+        StreamEvent* data = new StreamEvent(std::move(event));
+        auto callback = [this](Napi::Env env, Napi::Function jsCallback, StreamEvent* data) {
+            std::unique_ptr<StreamEvent> owned(data);
+            Napi::Object object = eventToObject(env, *owned);
+            if (owned->kind == StreamEvent::Kind::End) {
+                // The reader thread returns right after queueing the end event
+                reader_->stop();
+                Unref();
+            }
+            jsCallback.Call({object});
+        };
+        napi_status status = end ? events_.BlockingCall(data, callback) : events_.NonBlockingCall(data, callback);
+        if (status != napi_ok) {
+            delete data;
+            if (status == napi_queue_full) dropped_++;
+        }
+        if (end) events_.Release();
+    }
+
+    // Helper function to convert a stream event to the object passed to the JS callback
+    Napi::Object eventToObject(Napi::Env env, const StreamEvent& event) {
+        const AnalysisOptions& analysis = options_.session.analysis;
+        Napi::Object object;
+        switch (event.kind) {
+            case StreamEvent::Kind::Result:
+                object = sessionFrameToObject(env, event.frame, options_.session);
+                object.Set("type", Napi::String::New(env, "result"));
+                if (analysis.timings) setTimings(env, object, event.timings);
+                break;
+            case StreamEvent::Kind::Error:
+                object = Napi::Object::New(env);
+                object.Set("type", Napi::String::New(env, "error"));
+                object.Set("message", Napi::String::New(env, event.error));
+                break;
+            case StreamEvent::Kind::End:
+                object = Napi::Object::New(env);
+                object.Set("type", Napi::String::New(env, "end"));
+                object.Set("framesRead", Napi::Number::New(env, static_cast<double>(event.frameIndex)));
+                object.Set("dropped", Napi::Number::New(env, static_cast<double>(dropped_.load())));
+                if (!event.error.empty()) object.Set("error", Napi::String::New(env, event.error));
+                return object;
+        }
+        object.Set("frameIndex", Napi::Number::New(env, static_cast<double>(event.frameIndex)));
+        object.Set("timestamp", Napi::Number::New(env, event.timestampMs));
+        return object;
+    }
+
+    std::string url_;
+    StreamOptions options_;
+    Napi::FunctionReference callback_;
+    Napi::ThreadSafeFunction events_;
+    std::unique_ptr<StreamReader> reader_;
+    std::atomic<uint64_t> dropped_{0};
+};
+#endif
+
+// Helper function to describe the current configure() settings
+Napi::Object settingsToObject(Napi::Env env) {
+    ParallelismConfig& config = parallelismConfig();
+    size_t poolThreads;
+    {
+        std::lock_guard<std::mutex> lock(config.mutex);
+        poolThreads = config.poolThreads;
+    }
     Napi::Object result = Napi::Object::New(env);
+    result.Set("opencvThreads", Napi::Number::New(env, cv::getNumThreads()));
+    result.Set("poolThreads", Napi::Number::New(env, static_cast<double>(poolThreads)));
+    result.Set("parallelism", Napi::String::New(env, config.intraFrame.load() ? "intraFrame" : "frame"));
+    result.Set("stageStats", Napi::Boolean::New(env, gStageStatsEnabled.load()));
+    result.Set("openclAvailable", Napi::Boolean::New(env, openclAvailable()));
+    result.Set("analysisBudget", Napi::Number::New(env, sharedAnalysisBudget().millisecondsPerSecond()));
+    return result;
+}
 
-    // Validate input
-    if (info.Length() < 1) {
-        Napi::Error::New(env, "Expected an image path or buffer").ThrowAsJavaScriptException();
-        result.Set("error", Napi::String::New(env, "Expected an image path or buffer"));
-        return result;
+// configure({ opencvThreads, poolThreads, parallelism, stageStats, analysisBudget }) applies the given settings and
+// returns the resulting ones. Options are validated before any of them is applied.
+Napi::Value Configure(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    if (info[0].IsUndefined()) {
+        return settingsToObject(env);
+    }
+    if (!info[0].IsObject()) {
+        Napi::TypeError::New(env, "Expected an options object").ThrowAsJavaScriptException();
+        return env.Undefined();
     }
+    Napi::Object options = info[0].As<Napi::Object>();
 
-    // Read input image
-    cv::Mat image;
-    if (info[0].IsString()) {
-        std::string imagePath = info[0].As<Napi::String>().Utf8Value();
-        image = cv::imread(imagePath);
-    } else if (info[0].IsBuffer()) {
-        Napi::Buffer<uint8_t> buffer = info[0].As<Napi::Buffer<uint8_t>>();
-        std::vector<uint8_t> vec(buffer.Data(), buffer.Data() + buffer.Length());
-        image = cv::imdecode(vec, cv::IMREAD_COLOR);
-    } else {
-        Napi::Error::New(env, "Input must be a string (file path) or buffer").ThrowAsJavaScriptException();
-        result.Set("error", Napi::String::New(env, "Input must be a string (file path) or buffer"));
-        return result;
+    auto readCount = [&](const char* name, int min, int max, int& value) {
+        Napi::Value property = options.Get(name);
+        if (property.IsUndefined()) return true;
+        double number = property.IsNumber() ? property.As<Napi::Number>().DoubleValue() : -1.0;
+        if (!(number >= min && number <= max) || number != std::floor(number)) {
+            Napi::TypeError::New(env, std::string(name) + " must be an integer between " + std::to_string(min) +
+                                 " and " + std::to_string(max)).ThrowAsJavaScriptException();
+            return false;
+        }
+        value = static_cast<int>(number);
+        return true;
+    };
+    int opencvThreads = -1, poolThreads = -1;
+    if (!readCount("opencvThreads", 0, 1024, opencvThreads) || !readCount("poolThreads", 1, 1024, poolThreads)) {
+        return env.Undefined();
     }
 
-    if (image.empty()) {
-        Napi::Error::New(env, "Could not read image").ThrowAsJavaScriptException();
-        result.Set("error", Napi::String::New(env, "Could not read image"));
-        return result;
+    int intraFrame = -1;
+    Napi::Value parallelism = options.Get("parallelism");
+    if (!parallelism.IsUndefined()) {
+        std::string name = parallelism.IsString() ? parallelism.As<Napi::String>().Utf8Value() : "";
+        if (name != "frame" && name != "intraFrame") {
+            Napi::TypeError::New(env, "parallelism must be 'frame' or 'intraFrame'").ThrowAsJavaScriptException();
+            return env.Undefined();
+        }
+        intraFrame = name == "intraFrame" ? 1 : 0;
     }
 
-    // Convert to grayscale
-    cv::Mat gray;
-    cv::cvtColor(image, gray, cv::COLOR_BGR2GRAY);
-
-    // Calculate global defocus score
-    double defocusScore = calculateDefocusScore(gray);
-
-    // Calculate global contrast and brightness
-    cv::Scalar meanIntensity, stddevIntensity;
-    cv::meanStdDev(gray, meanIntensity, stddevIntensity);
-    double brightness = meanIntensity[0];
-    double contrastScore = 100.0 - std::min(100.0, std::max(0.0, (stddevIntensity[0] / 10.0) * 100.0));
-
-    // Calculate edge density
-    cv::Mat edges;
-    cv::Canny(gray, edges, 50, 150);
-    double edgeDensity = cv::countNonZero(edges) / (double)(edges.rows * edges.cols);
-    double edgeScore = 100.0 - std::min(100.0, edgeDensity * 150.0);
-
-    // Calculate intensity histogram
-    cv::Mat hist;
-    int histSize = 256;
-    float range[] = {0, 256};
-    const float* histRange = {range};
-    cv::calcHist(&gray, 1, 0, cv::Mat(), hist, 1, &histSize, &histRange);
-
-    // Calculate percentage of different intensity ranges
-    double darkPixels = 0, midPixels = 0, brightPixels = 0;
-    for (int i = 0; i < 256; i++) {
-        if (i < 85) darkPixels += hist.at<float>(i);
-        else if (i < 170) midPixels += hist.at<float>(i);
-        else brightPixels += hist.at<float>(i);
-    }
-    double totalPixels = gray.rows * gray.cols;
-    double darkPercentage = (darkPixels / totalPixels) * 100.0;
-    double midPercentage = (midPixels / totalPixels) * 100.0;
-    double brightPercentage = (brightPixels / totalPixels) * 100.0;
-
-    // Calculate smear score based on combined characteristics
-    double smearScore = 0.0;
-
-    // Calculate base characteristics score with adjusted weights
-    double baseScore = (defocusScore * 0.5) + (contrastScore * 0.3) + (edgeScore * 0.2);
-
-    // Calculate intensity distribution score with adjusted thresholds
-    double intensityScore = 0.0;
-    
-    // Adjust thresholds based on overall brightness
-    double brightnessFactor = std::min(1.0, brightness / 120.0);
-    double darkThreshold = 8.0 + (brightnessFactor * 3.0);
-    double brightThreshold = 8.0 + ((1.0 - brightnessFactor) * 3.0);
-    double midThreshold = 15.0 + (brightnessFactor * 2.0);
-
-    // Increase sensitivity to bright conditions
-    if (brightness > 120.0) {
-        intensityScore += (brightness - 120.0) * 0.8;
-    }
-
-    if (darkPercentage > darkThreshold) intensityScore += darkPercentage * 0.5;
-    if (brightPercentage > brightThreshold) intensityScore += brightPercentage * 0.5;
-    if (midPercentage > midThreshold) intensityScore += midPercentage * 0.3;
-
-    // Calculate combined score
-    double combinedScore = baseScore + (intensityScore * 0.4);
-
-    // Invert the scoring logic - higher scores for smears, lower for normal images
-    if (combinedScore > 20.0) { // Lower threshold to catch more smears
-        // Give high scores for smears
-        smearScore = std::min(100.0, 20.0 + (combinedScore - 20.0) * 1.5);
-    } else {
-        // Give low scores for normal images
-        smearScore = combinedScore * 0.5;
+    Napi::Value stageStats = options.Get("stageStats");
+    if (!stageStats.IsUndefined() && !stageStats.IsBoolean()) {
+        Napi::TypeError::New(env, "stageStats must be a boolean").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    double analysisBudget = -1.0;
+    Napi::Value budget = options.Get("analysisBudget");
+    if (!budget.IsUndefined()) {
+        analysisBudget = budget.IsNumber() ? budget.As<Napi::Number>().DoubleValue() : -1.0;
+        if (!(analysisBudget >= 0.0 && analysisBudget <= 1e6)) {
+            Napi::TypeError::New(env, "analysisBudget must be milliseconds per second between 0 and 1000000")
+                .ThrowAsJavaScriptException();
+            return env.Undefined();
+        }
     }
 
-    // Set result property
-    result.Set("smearScore", Napi::Number::New(env, smearScore));
+    if (opencvThreads >= 0) cv::setNumThreads(opencvThreads);
+    if (poolThreads > 0) resizeSharedThreadPool(static_cast<size_t>(poolThreads));
+    if (intraFrame >= 0) parallelismConfig().intraFrame = intraFrame == 1;
+    if (stageStats.IsBoolean()) gStageStatsEnabled = stageStats.As<Napi::Boolean>().Value();
+    if (analysisBudget >= 0.0) sharedAnalysisBudget().configure(analysisBudget);
+    return settingsToObject(env);
+}
+
+// Reports the scratch memory pooled by all threads that have processed frames
+Napi::Value GetScratchMemory(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    size_t threads = 0;
+    size_t bytes = ScratchArena::totalBytes(&threads);
+
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("bytes", Napi::Number::New(env, static_cast<double>(bytes)));
+    result.Set("threads", Napi::Number::New(env, static_cast<double>(threads)));
+    return result;
+}
+
+// Frees the pooled scratch memory of all threads and returns the number of bytes released
+Napi::Value ReleaseScratchMemory(const Napi::CallbackInfo& info) {
+    return Napi::Number::New(info.Env(), static_cast<double>(ScratchArena::releaseAll()));
+}
+
+// Reports the process-wide stage statistics collected while configure({ stageStats: true })
+// is in effect. Bucket counts are cumulative, as in a Prometheus histogram.
+Napi::Value GetStageStats(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    Napi::Object stages = Napi::Object::New(env);
+    Napi::Array bounds = Napi::Array::New(env);
+    uint64_t frames = 0;
+    for (int i = 0; i < kStageCount; i++) {
+        StageSummary summary = stageSummary(static_cast<Stage>(i));
+        if (static_cast<Stage>(i) == Stage::Total) frames = summary.count;
+        Napi::Array counts = Napi::Array::New(env, summary.buckets.size());
+        for (size_t b = 0; b < summary.buckets.size(); b++) {
+            // Every stage uses the same bounds
+            if (i == 0) bounds.Set(static_cast<uint32_t>(b), Napi::Number::New(env, summary.buckets[b].first));
+            counts.Set(static_cast<uint32_t>(b), Napi::Number::New(env, static_cast<double>(summary.buckets[b].second)));
+        }
+
+        Napi::Object stage = Napi::Object::New(env);
+        stage.Set("count", Napi::Number::New(env, static_cast<double>(summary.count)));
+        stage.Set("totalMs", Napi::Number::New(env, summary.totalMilliseconds));
+        stage.Set("p50Ms", Napi::Number::New(env, summary.p50Milliseconds));
+        stage.Set("p99Ms", Napi::Number::New(env, summary.p99Milliseconds));
+        stage.Set("bucketCounts", counts);
+        stages.Set(stageName(static_cast<Stage>(i)), stage);
+    }
 
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("enabled", Napi::Boolean::New(env, gStageStatsEnabled.load()));
+    result.Set("frames", Napi::Number::New(env, static_cast<double>(frames)));
+    result.Set("bucketBoundsMs", bounds);
+    result.Set("stages", stages);
     return result;
 }
 
+// Clears the process-wide stage statistics
+Napi::Value ResetStageStats(const Napi::CallbackInfo& info) {
+    resetStageStats();
+    return info.Env().Undefined();
+}
+
 Napi::Object Init(Napi::Env env, Napi::Object exports) {
     exports.Set(
         Napi::String::New(env, "detectSabotage"),
@@ -360,6 +1726,88 @@ Napi::Object Init(Napi::Env env, Napi::Object exports) {
         Napi::String::New(env, "detectSmear"),
         Napi::Function::New(env, DetectSmear)
     );
+    exports.Set(
+        Napi::String::New(env, "detectSabotageAsync"),
+        Napi::Function::New(env, DetectSabotageAsync)
+    );
+    exports.Set(
+        Napi::String::New(env, "detectSabotageRawAsync"),
+        Napi::Function::New(env, DetectSabotageRawAsync)
+    );
+    exports.Set(
+        Napi::String::New(env, "detectSceneChangeAsync"),
+        Napi::Function::New(env, DetectSceneChangeAsync)
+    );
+    exports.Set(
+        Napi::String::New(env, "detectSmearAsync"),
+        Napi::Function::New(env, DetectSmearAsync)
+    );
+    exports.Set(
+        Napi::String::New(env, "detectSabotageBatchAsync"),
+        Napi::Function::New(env, DetectSabotageBatchAsync)
+    );
+    exports.Set(
+        Napi::String::New(env, "processFiles"),
+        Napi::Function::New(env, ProcessFiles)
+    );
+    exports.Set(
+        Napi::String::New(env, "configure"),
+        Napi::Function::New(env, Configure)
+    );
+    exports.Set(
+        Napi::String::New(env, "getScratchMemory"),
+        Napi::Function::New(env, GetScratchMemory)
+    );
+    exports.Set(
+        Napi::String::New(env, "releaseScratchMemory"),
+        Napi::Function::New(env, ReleaseScratchMemory)
+    );
+    exports.Set(
+        Napi::String::New(env, "getStageStats"),
+        Napi::Function::New(env, GetStageStats)
+    );
+    exports.Set(
+        Napi::String::New(env, "resetStageStats"),
+        Napi::Function::New(env, ResetStageStats)
+    );
+    exports.Set(
+        Napi::String::New(env, "CameraSession"),
+        CameraSession::Init(env)
+    );
+#ifdef SABOTAGE_WITH_VIDEOIO
+    exports.Set(
+        Napi::String::New(env, "VideoSource"),
+        VideoSource::Init(env)
+    );
+#endif
+
+    Napi::Object resultSlots = Napi::Object::New(env);
+    resultSlots.Set("DEFOCUS", Napi::Number::New(env, kSlotDefocus));
+    resultSlots.Set("BLACKOUT", Napi::Number::New(env, kSlotBlackout));
+    resultSlots.Set("FLASH", Napi::Number::New(env, kSlotFlash));
+    resultSlots.Set("SMEAR", Napi::Number::New(env, kSlotSmear));
+    resultSlots.Set("SCENE_CHANGE", Napi::Number::New(env, kSlotSceneChange));
+    resultSlots.Set("FLAGS", Napi::Number::New(env, kSlotFlags));
+    resultSlots.Set("ALERTS", Napi::Number::New(env, kSlotAlerts));
+    resultSlots.Set("ALERTS_CHANGED", Napi::Number::New(env, kSlotAlertsChanged));
+    exports.Set("RESULT_SLOTS", resultSlots);
+    exports.Set("RESULT_STRIDE", Napi::Number::New(env, kResultStride));
+
+    Napi::Object resultFlags = Napi::Object::New(env);
+    resultFlags.Set("OK", Napi::Number::New(env, kFlagOk));
+    resultFlags.Set("SHORT_CIRCUITED", Napi::Number::New(env, kFlagShortCircuited));
+    resultFlags.Set("REUSED", Napi::Number::New(env, kFlagReused));
+    resultFlags.Set("CACHED", Napi::Number::New(env, kFlagCached));
+    resultFlags.Set("FROZEN", Napi::Number::New(env, kFlagFrozen));
+    exports.Set("RESULT_FLAGS", resultFlags);
+
+    Napi::Object metrics = Napi::Object::New(env);
+    metrics.Set("DEFOCUS", Napi::Number::New(env, kMetricDefocus));
+    metrics.Set("BLACKOUT", Napi::Number::New(env, kMetricBlackout));
+    metrics.Set("FLASH", Napi::Number::New(env, kMetricFlash));
+    metrics.Set("SMEAR", Napi::Number::New(env, kMetricSmear));
+    metrics.Set("SCENE_CHANGE", Napi::Number::New(env, kMetricSceneChange));
+    exports.Set("METRICS", metrics);
     return exports;
 }
 
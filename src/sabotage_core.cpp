@@ -0,0 +1,1675 @@
+#include "sabotage_core.h"
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SABOTAGE_USE_SSE2 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define SABOTAGE_USE_NEON 1
+#endif
+
+thread_local bool tFrameLevelOnly = false;
+thread_local StageTimings* tStageTimings = nullptr;
+std::atomic<bool> gStageStatsEnabled{false};
+
+const char* stageName(Stage stage) {
+    switch (stage) {
+        case Stage::Decode: return "decode";
+        case Stage::Histogram: return "histogram";
+        case Stage::Laplacian: return "laplacian";
+        case Stage::Edges: return "edges";
+        case Stage::Grid: return "grid";
+        case Stage::SceneChange: return "sceneChange";
+        case Stage::Total: return "total";
+        case Stage::Count: break;
+    }
+    return "";
+}
+
+// Log-scale duration histogram, two buckets per power of two from 1 microsecond up to
+// about 12 seconds plus an overflow bucket. Lock-free so worker threads never contend.
+class StageHistogram {
+public:
+    static const int kBuckets = 48;
+
+    // Upper bound of bucket i in milliseconds; the overflow bucket is unbounded
+    static double upperBound(int i) {
+        return i < kBuckets ? 0.001 * std::pow(2.0, i / 2.0) : std::numeric_limits<double>::infinity();
+    }
+
+    void add(uint64_t nanoseconds) {
+        double microseconds = nanoseconds / 1000.0;
+        int bucket = microseconds <= 1.0 ? 0 : static_cast<int>(std::ceil(2.0 * std::log2(microseconds)));
+        counts_[std::min(bucket, kBuckets)].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        totalNanoseconds_.fetch_add(nanoseconds, std::memory_order_relaxed);
+    }
+
+    StageSummary summary() const {
+        StageSummary summary;
+        uint64_t counts[kBuckets + 1];
+        for (int i = 0; i <= kBuckets; i++) {
+            counts[i] = counts_[i].load(std::memory_order_relaxed);
+            summary.count += counts[i];
+        }
+        summary.totalMilliseconds = totalNanoseconds_.load(std::memory_order_relaxed) / 1e6;
+        summary.p50Milliseconds = quantile(counts, summary.count, 0.5);
+        summary.p99Milliseconds = quantile(counts, summary.count, 0.99);
+        uint64_t cumulative = 0;
+        for (int i = 0; i <= kBuckets; i++) {
+            cumulative += counts[i];
+            summary.buckets.emplace_back(upperBound(i), cumulative);
+        }
+        return summary;
+    }
+
+    void reset() {
+        for (std::atomic<uint64_t>& count : counts_) count.store(0, std::memory_order_relaxed);
+        count_.store(0, std::memory_order_relaxed);
+        totalNanoseconds_.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    // Helper function to interpolate a quantile linearly inside the bucket that holds it
+    static double quantile(const uint64_t* counts, uint64_t total, double q) {
+        if (total == 0) return 0.0;
+        double target = q * total;
+        uint64_t below = 0;
+        for (int i = 0; i <= kBuckets; i++) {
+            if (counts[i] > 0 && below + counts[i] >= target) {
+                double lower = i > 0 ? upperBound(i - 1) : 0.0;
+                if (i == kBuckets) return lower;
+                return lower + (upperBound(i) - lower) * (target - below) / counts[i];
+            }
+            below += counts[i];
+        }
+        return upperBound(kBuckets - 1);
+    }
+
+    std::atomic<uint64_t> counts_[kBuckets + 1] = {};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> totalNanoseconds_{0};
+};
+
+StageHistogram* stageHistograms() {
+    static StageHistogram histograms[kStageCount];
+    return histograms;
+}
+
+void recordStage(Stage stage, std::chrono::steady_clock::duration elapsed) {
+    int index = static_cast<int>(stage);
+    int64_t nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+    if (tStageTimings != nullptr) {
+        tStageTimings->recorded |= 1u << index;
+        tStageTimings->milliseconds[index] += nanoseconds / 1e6;
+    }
+    if (gStageStatsEnabled.load(std::memory_order_relaxed)) {
+        stageHistograms()[index].add(static_cast<uint64_t>(std::max<int64_t>(0, nanoseconds)));
+    }
+}
+
+StageSummary stageSummary(Stage stage) {
+    return stageHistograms()[static_cast<int>(stage)].summary();
+}
+
+void resetStageStats() {
+    for (int i = 0; i < kStageCount; i++) {
+        stageHistograms()[i].reset();
+    }
+}
+
+// Helper function to wrap encoded bytes in a cv::Mat header without copying them
+cv::Mat wrapEncodedBuffer(const uint8_t* data, size_t length) {
+    return cv::Mat(1, static_cast<int>(length), CV_8UC1, const_cast<uint8_t*>(data));
+}
+
+// Helper function to read image from buffer, decoding into a pooled buffer
+cv::Mat readImageFromBuffer(const uint8_t* data, size_t length, int flags) {
+    if (data == nullptr || length == 0) return cv::Mat();
+    if (length > kMaxEncodedImageBytes) throw std::length_error("Encoded image is 2 GiB or larger");
+    ScratchArena::Scope scratch;
+    cv::Mat& image = scratch.arena().decodeTarget();
+    cv::imdecode(wrapEncodedBuffer(data, length), flags, &image);
+    return image;
+}
+
+// Helper function to get a grayscale view of a raw frame. Gray and YUV frames are
+// wrapped in place (the Y plane is the grayscale image); BGR frames are converted.
+cv::Mat readImageFromRaw(const RawFrame& frame) {
+    uint8_t* data = const_cast<uint8_t*>(frame.data);
+    switch (frame.format) {
+        case PixelFormat::Gray8:
+        case PixelFormat::NV12:
+        case PixelFormat::I420:
+            return cv::Mat(frame.height, frame.width, CV_8UC1, data, frame.stride);
+        case PixelFormat::BGR: {
+            cv::Mat bgr(frame.height, frame.width, CV_8UC3, data, frame.stride);
+            ScratchArena::Scope scratch;
+            cv::Mat& gray = scratch.arena().image(ScratchImage::Converted);
+            cv::cvtColor(bgr, gray, cv::COLOR_BGR2GRAY);
+            return gray;
+        }
+    }
+    return cv::Mat();
+}
+
+// Helper function to map an analysis scale to the matching reduced grayscale decode mode.
+// JPEG decoders apply these through DCT scaling, so reduced decodes are nearly free.
+int grayscaleReadFlag(int analysisScale) {
+    switch (analysisScale) {
+        case 2: return cv::IMREAD_REDUCED_GRAYSCALE_2;
+        case 4: return cv::IMREAD_REDUCED_GRAYSCALE_4;
+        case 8: return cv::IMREAD_REDUCED_GRAYSCALE_8;
+        default: return cv::IMREAD_GRAYSCALE;
+    }
+}
+
+// Helper function to downsample a grayscale frame by an integer factor into reduced
+cv::Mat downscaleGray(const cv::Mat& gray, int analysisScale, cv::Mat& reduced) {
+    if (analysisScale <= 1 || gray.empty()) return gray;
+    cv::Size size(std::max(1, gray.cols / analysisScale), std::max(1, gray.rows / analysisScale));
+    cv::resize(gray, reduced, size, 0, 0, cv::INTER_AREA);
+    return reduced;
+}
+
+cv::Mat downscaleGray(const cv::Mat& gray, int analysisScale) {
+    ScratchArena::Scope scratch;
+    return downscaleGray(gray, analysisScale, scratch.arena().image(ScratchImage::Resized));
+}
+
+// Helper function to mirror an out-of-range index the way BORDER_REFLECT_101 does
+inline int reflect101(int i, int n) {
+    if (n == 1) return 0;
+    if (i < 0) return -i;
+    if (i >= n) return 2 * n - 2 - i;
+    return i;
+}
+
+// Running sums of the Laplacian response over a set of pixels, plus the number of those
+// pixels whose Sobel gradient magnitude reaches the strong-gradient threshold
+struct LaplacianSums {
+    int64_t sum = 0;
+    uint64_t squares = 0;
+    uint64_t pixels = 0;
+    uint64_t strongGradients = 0;
+
+    void add(const LaplacianSums& other) {
+        sum += other.sum;
+        squares += other.squares;
+        pixels += other.pixels;
+        strongGradients += other.strongGradients;
+    }
+
+    double variance() const {
+        if (pixels == 0) return 0.0;
+        double n = static_cast<double>(pixels);
+        double mean = sum / n;
+        return std::max(0.0, squares / n - mean * mean);
+    }
+};
+
+// Helper function to add the Laplacian (and optionally the Sobel gradient test) of one
+// pixel, with reflected neighbours
+inline void accumulateLaplacianPixel(const uchar* up, const uchar* row, const uchar* down, int cols, int x,
+                                     int gradientThreshold, LaplacianSums& sums) {
+    int xl = reflect101(x - 1, cols);
+    int xr = reflect101(x + 1, cols);
+    int64_t laplacian = up[x] + down[x] + row[xl] + row[xr] - 4 * row[x];
+    sums.sum += laplacian;
+    sums.squares += static_cast<uint64_t>(laplacian * laplacian);
+    sums.pixels++;
+    if (gradientThreshold > 0) {
+        int gx = (up[xr] + 2 * row[xr] + down[xr]) - (up[xl] + 2 * row[xl] + down[xl]);
+        int gy = (down[xl] + 2 * down[x] + down[xr]) - (up[xl] + 2 * up[x] + up[xr]);
+        if (std::abs(gx) + std::abs(gy) >= gradientThreshold) sums.strongGradients++;
+    }
+}
+
+// Helper function to accumulate the Laplacian of columns [from, to) of one row. This is
+// the cv::Laplacian(ksize = 1) kernel with BORDER_REFLECT_101, evaluated in 16-bit lanes
+// and summed on the fly so no full-frame response image is written. up/down are the
+// neighbouring rows (already reflected at the top and bottom edges). Pixels where
+// maskRow is zero are skipped; maskRow may be null. When gradientThreshold is positive,
+// pixels whose L1 Sobel magnitude |gx| + |gy| reaches it are counted from the same loads.
+void accumulateLaplacianRow(const uchar* up, const uchar* row, const uchar* down, const uchar* maskRow,
+                            int cols, int from, int to, LaplacianSums& sums, int gradientThreshold = 0) {
+    // Border columns need reflected neighbours, interior columns are vectorized
+    int x = from;
+    for (; x < std::min(to, 1); x++) {
+        if (!maskRow || maskRow[x]) accumulateLaplacianPixel(up, row, down, cols, x, gradientThreshold, sums);
+    }
+
+#if defined(SABOTAGE_USE_SSE2) || defined(SABOTAGE_USE_NEON)
+    int interiorEnd = std::min(to, cols - 1);
+    bool countGradients = gradientThreshold > 0;
+    // 32-bit lane sums are flushed to 64 bits every kFlushInterval vectors, well before
+    // the squares (at most 4 * 1020^2 per lane and vector) could overflow
+    const int kFlushInterval = 256;
+    int32_t laneSums[4], laneSquares[4];
+    uint32_t laneCounts[4], laneGradients[4];
+    auto flushLanes = [&]() {
+        for (int i = 0; i < 4; i++) {
+            sums.sum += laneSums[i];
+            sums.squares += static_cast<uint32_t>(laneSquares[i]);
+            sums.pixels += laneCounts[i];
+            sums.strongGradients += laneGradients[i];
+        }
+    };
+#endif
+
+#if defined(SABOTAGE_USE_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ones16 = _mm_set1_epi16(1);
+    const __m128i ones8 = _mm_set1_epi8(1);
+    const __m128i allLanes = _mm_set1_epi8(-1);
+    const __m128i gradientLimit = _mm_set1_epi16(static_cast<short>(gradientThreshold - 1));
+    auto absolute = [&](__m128i v) { return _mm_max_epi16(v, _mm_sub_epi16(zero, v)); };
+    while (x + 16 <= interiorEnd) {
+        __m128i sum32 = zero, squares32 = zero, count64 = zero, gradients16 = zero;
+        for (int block = 0; block < kFlushInterval && x + 16 <= interiorEnd; block++, x += 16) {
+            __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x));
+            __m128i l = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x - 1));
+            __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x + 1));
+            __m128i u = _mm_loadu_si128(reinterpret_cast<const __m128i*>(up + x));
+            __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(down + x));
+
+            __m128i keep = allLanes;
+            if (maskRow) {
+                __m128i m = _mm_loadu_si128(reinterpret_cast<const __m128i*>(maskRow + x));
+                keep = _mm_andnot_si128(_mm_cmpeq_epi8(m, zero), allLanes);
+                count64 = _mm_add_epi64(count64, _mm_sad_epu8(_mm_and_si128(keep, ones8), zero));
+            } else {
+                count64 = _mm_add_epi64(count64, _mm_set_epi32(0, 0, 0, 16));
+            }
+
+            __m128i ul = zero, ur = zero, dl = zero, dr = zero;
+            if (countGradients) {
+                ul = _mm_loadu_si128(reinterpret_cast<const __m128i*>(up + x - 1));
+                ur = _mm_loadu_si128(reinterpret_cast<const __m128i*>(up + x + 1));
+                dl = _mm_loadu_si128(reinterpret_cast<const __m128i*>(down + x - 1));
+                dr = _mm_loadu_si128(reinterpret_cast<const __m128i*>(down + x + 1));
+            }
+
+            // Low and high eight pixels in 16-bit lanes
+            for (int half = 0; half < 2; half++) {
+                auto widen = [&](__m128i v) { return half ? _mm_unpackhi_epi8(v, zero) : _mm_unpacklo_epi8(v, zero); };
+                __m128i keep16 = half ? _mm_unpackhi_epi8(keep, keep) : _mm_unpacklo_epi8(keep, keep);
+                __m128i cw = widen(c), lw = widen(l), rw = widen(r), uw = widen(u), dw = widen(d);
+
+                __m128i lap = _mm_sub_epi16(_mm_add_epi16(_mm_add_epi16(uw, dw), _mm_add_epi16(lw, rw)),
+                                            _mm_slli_epi16(cw, 2));
+                lap = _mm_and_si128(lap, keep16);
+                sum32 = _mm_add_epi32(sum32, _mm_madd_epi16(lap, ones16));
+                squares32 = _mm_add_epi32(squares32, _mm_madd_epi16(lap, lap));
+
+                if (countGradients) {
+                    __m128i ulw = widen(ul), urw = widen(ur), dlw = widen(dl), drw = widen(dr);
+                    __m128i gx = _mm_add_epi16(_mm_sub_epi16(_mm_add_epi16(urw, drw), _mm_add_epi16(ulw, dlw)),
+                                               _mm_slli_epi16(_mm_sub_epi16(rw, lw), 1));
+                    __m128i gy = _mm_add_epi16(_mm_sub_epi16(_mm_add_epi16(dlw, drw), _mm_add_epi16(ulw, urw)),
+                                               _mm_slli_epi16(_mm_sub_epi16(dw, uw), 1));
+                    __m128i strong = _mm_cmpgt_epi16(_mm_add_epi16(absolute(gx), absolute(gy)), gradientLimit);
+                    gradients16 = _mm_sub_epi16(gradients16, _mm_and_si128(strong, keep16));
+                }
+            }
+        }
+        // Fold the two 64-bit pixel counts into the low lane before flushing
+        count64 = _mm_add_epi64(count64, _mm_srli_si128(count64, 8));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(laneSums), sum32);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(laneSquares), squares32);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(laneGradients), _mm_madd_epi16(gradients16, ones16));
+        laneCounts[0] = static_cast<uint32_t>(_mm_cvtsi128_si32(count64));
+        laneCounts[1] = laneCounts[2] = laneCounts[3] = 0;
+        flushLanes();
+    }
+#elif defined(SABOTAGE_USE_NEON)
+    const uint8x16_t ones8 = vdupq_n_u8(1);
+    const int16x8_t gradientLimit = vdupq_n_s16(static_cast<int16_t>(gradientThreshold));
+    while (x + 16 <= interiorEnd) {
+        int32x4_t sum32 = vdupq_n_s32(0), squares32 = vdupq_n_s32(0);
+        uint32x4_t count32 = vdupq_n_u32(0);
+        uint16x8_t gradients16 = vdupq_n_u16(0);
+        for (int block = 0; block < kFlushInterval && x + 16 <= interiorEnd; block++, x += 16) {
+            uint8x16_t c = vld1q_u8(row + x);
+            uint8x16_t l = vld1q_u8(row + x - 1);
+            uint8x16_t r = vld1q_u8(row + x + 1);
+            uint8x16_t u = vld1q_u8(up + x);
+            uint8x16_t d = vld1q_u8(down + x);
+
+            uint8x16_t keep = vdupq_n_u8(0xFF);
+            if (maskRow) {
+                uint8x16_t m = vld1q_u8(maskRow + x);
+                keep = vtstq_u8(m, m);
+                count32 = vpadalq_u16(count32, vpaddlq_u8(vandq_u8(keep, ones8)));
+            } else {
+                count32 = vaddq_u32(count32, vdupq_n_u32(4));
+            }
+
+            uint8x16_t ul = keep, ur = keep, dl = keep, dr = keep;
+            if (countGradients) {
+                ul = vld1q_u8(up + x - 1);
+                ur = vld1q_u8(up + x + 1);
+                dl = vld1q_u8(down + x - 1);
+                dr = vld1q_u8(down + x + 1);
+            }
+
+            // Low and high eight pixels in 16-bit lanes
+            for (int half = 0; half < 2; half++) {
+                auto widen = [&](uint8x16_t v) {
+                    return vreinterpretq_s16_u16(vmovl_u8(half ? vget_high_u8(v) : vget_low_u8(v)));
+                };
+                int16x8_t keep16 = vmovl_s8(vreinterpret_s8_u8(half ? vget_high_u8(keep) : vget_low_u8(keep)));
+                int16x8_t cw = widen(c), lw = widen(l), rw = widen(r), uw = widen(u), dw = widen(d);
+
+                int16x8_t lap = vsubq_s16(vaddq_s16(vaddq_s16(uw, dw), vaddq_s16(lw, rw)), vshlq_n_s16(cw, 2));
+                lap = vandq_s16(lap, keep16);
+                sum32 = vpadalq_s16(sum32, lap);
+                squares32 = vmlal_s16(squares32, vget_low_s16(lap), vget_low_s16(lap));
+                squares32 = vmlal_s16(squares32, vget_high_s16(lap), vget_high_s16(lap));
+
+                if (countGradients) {
+                    int16x8_t ulw = widen(ul), urw = widen(ur), dlw = widen(dl), drw = widen(dr);
+                    int16x8_t gx = vaddq_s16(vsubq_s16(vaddq_s16(urw, drw), vaddq_s16(ulw, dlw)),
+                                             vshlq_n_s16(vsubq_s16(rw, lw), 1));
+                    int16x8_t gy = vaddq_s16(vsubq_s16(vaddq_s16(dlw, drw), vaddq_s16(ulw, urw)),
+                                             vshlq_n_s16(vsubq_s16(dw, uw), 1));
+                    uint16x8_t strong = vcgeq_s16(vaddq_s16(vabsq_s16(gx), vabsq_s16(gy)), gradientLimit);
+                    gradients16 = vsubq_u16(gradients16, vandq_u16(strong, vreinterpretq_u16_s16(keep16)));
+                }
+            }
+        }
+        vst1q_s32(laneSums, sum32);
+        vst1q_s32(laneSquares, squares32);
+        vst1q_u32(laneCounts, count32);
+        vst1q_u32(laneGradients, vpaddlq_u16(gradients16));
+        flushLanes();
+    }
+#endif
+
+    for (; x < to; x++) {
+        if (!maskRow || maskRow[x]) accumulateLaplacianPixel(up, row, down, cols, x, gradientThreshold, sums);
+    }
+}
+
+// Pixel counts per intensity spread over several sub-histograms: neighbouring pixels
+// usually share a value, and incrementing the same counter back to back stalls on the
+// store-to-load dependency, so consecutive pixels go to different sub-histograms
+struct HistogramAccumulator {
+    static const int kLanes = 4;
+    uint32_t counts[kLanes][256] = {};
+
+    void add(const HistogramAccumulator& other) {
+        for (int lane = 0; lane < kLanes; lane++) {
+            for (int i = 0; i < 256; i++) counts[lane][i] += other.counts[lane][i];
+        }
+    }
+
+    // Helper function to fold the sub-histograms into a single 256-bin histogram
+    void mergeInto(uint32_t* histogram) const {
+        for (int i = 0; i < 256; i++) {
+            histogram[i] = counts[0][i] + counts[1][i] + counts[2][i] + counts[3][i];
+        }
+    }
+};
+
+// Helper function to count n consecutive pixels, eight at a time from one 64-bit load
+inline void accumulateHistogramSpan(const uchar* pixels, int n, HistogramAccumulator& histogram) {
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, pixels + i, sizeof(word));
+        histogram.counts[0][word & 0xFF]++;
+        histogram.counts[1][(word >> 8) & 0xFF]++;
+        histogram.counts[2][(word >> 16) & 0xFF]++;
+        histogram.counts[3][(word >> 24) & 0xFF]++;
+        histogram.counts[0][(word >> 32) & 0xFF]++;
+        histogram.counts[1][(word >> 40) & 0xFF]++;
+        histogram.counts[2][(word >> 48) & 0xFF]++;
+        histogram.counts[3][word >> 56]++;
+    }
+    for (; i < n; i++) {
+        histogram.counts[i & 3][pixels[i]]++;
+    }
+}
+
+// Helper function to add columns [from, to) of one row to the histogram. With a mask,
+// 16-pixel blocks that are fully inside or fully outside it are detected with one vector
+// compare and counted (or skipped) without per-pixel tests.
+void accumulateHistogramRow(const uchar* row, const uchar* maskRow, int from, int to,
+                            HistogramAccumulator& histogram) {
+    if (!maskRow) {
+        accumulateHistogramSpan(row + from, to - from, histogram);
+        return;
+    }
+
+    int x = from;
+#if defined(SABOTAGE_USE_SSE2) || defined(SABOTAGE_USE_NEON)
+    for (; x + 16 <= to; x += 16) {
+#if defined(SABOTAGE_USE_SSE2)
+        __m128i m = _mm_loadu_si128(reinterpret_cast<const __m128i*>(maskRow + x));
+        int outside = _mm_movemask_epi8(_mm_cmpeq_epi8(m, _mm_setzero_si128()));
+        bool allInside = outside == 0;
+        bool allOutside = outside == 0xFFFF;
+#else
+        uint8x16_t m = vld1q_u8(maskRow + x);
+        uint64x2_t keep = vreinterpretq_u64_u8(vtstq_u8(m, m));
+        uint64_t keepLo = vgetq_lane_u64(keep, 0), keepHi = vgetq_lane_u64(keep, 1);
+        bool allInside = (keepLo & keepHi) == ~0ull;
+        bool allOutside = (keepLo | keepHi) == 0;
+#endif
+        if (allInside) {
+            accumulateHistogramSpan(row + x, 16, histogram);
+        } else if (!allOutside) {
+            for (int i = x; i < x + 16; i++) {
+                if (maskRow[i]) histogram.counts[i & 3][row[i]]++;
+            }
+        }
+    }
+#endif
+    for (; x < to; x++) {
+        if (maskRow[x]) histogram.counts[x & 3][row[x]]++;
+    }
+}
+
+ParallelismConfig& parallelismConfig() {
+    static ParallelismConfig config;
+    return config;
+}
+
+// Helper function to get the shared pool, sized to the number of cores unless configured.
+// Callers keep the returned pointer for the duration of their work, so a resize never
+// destroys a pool that is still in use.
+std::shared_ptr<ThreadPool> sharedThreadPool() {
+    ParallelismConfig& config = parallelismConfig();
+    std::lock_guard<std::mutex> lock(config.mutex);
+    if (!config.pool) {
+        config.pool = std::make_shared<ThreadPool>(config.poolThreads);
+    }
+    return config.pool;
+}
+
+// Helper function to replace the shared pool with one of threadCount threads
+void resizeSharedThreadPool(size_t threadCount) {
+    ParallelismConfig& config = parallelismConfig();
+    std::shared_ptr<ThreadPool> previous;
+    {
+        std::lock_guard<std::mutex> lock(config.mutex);
+        if (threadCount == config.poolThreads && config.pool) return;
+        config.poolThreads = threadCount;
+        previous = std::move(config.pool);
+    }
+    // The old pool's threads are joined here, or by the last caller still using it
+}
+
+// Helper function to choose how many row stripes a frame is split into: one per pool
+// thread (plus the caller) in intra-frame mode, otherwise the whole frame on this thread
+size_t rowStripeCount(int rows) {
+    const int kMinStripeRows = 64;
+    if (tFrameLevelOnly || !parallelismConfig().intraFrame.load()) return 1;
+    size_t stripes = sharedThreadPool()->size() + 1;
+    return std::max<size_t>(1, std::min(stripes, static_cast<size_t>(rows / kMinStripeRows)));
+}
+
+// Helper function to run fn(stripe, rowBegin, rowEnd) over stripes equal row stripes of a
+// frame, on the shared pool when there is more than one
+void forEachRowStripe(int rows, size_t stripes, const std::function<void(size_t, int, int)>& fn) {
+    auto runStripe = [&](size_t stripe) {
+        int begin = static_cast<int>(static_cast<int64_t>(rows) * stripe / stripes);
+        int end = static_cast<int>(static_cast<int64_t>(rows) * (stripe + 1) / stripes);
+        fn(stripe, begin, end);
+    };
+    if (stripes <= 1) {
+        runStripe(0);
+        return;
+    }
+    std::shared_ptr<ThreadPool> pool = sharedThreadPool();
+    pool->parallelFor(stripes, runStripe);
+}
+
+// Helper function to sum histogram bins in [from, to)
+double histogramRange(const FrameFeatures& features, int from, int to) {
+    double count = 0.0;
+    for (int i = from; i < to; i++) {
+        count += features.histogram[i];
+    }
+    return count;
+}
+
+// Helper function to derive pixel count, mean and stddev exactly from the histogram
+void finalizeIntensityStats(FrameFeatures& features) {
+    const uint32_t* hist = features.histogram;
+    uint64_t count = 0, sum = 0, sumSquares = 0;
+    for (uint64_t i = 0; i < 256; i++) {
+        count += hist[i];
+        sum += i * hist[i];
+        sumSquares += i * i * hist[i];
+    }
+    features.totalPixels = static_cast<double>(count);
+    if (features.totalPixels > 0) {
+        features.mean = sum / features.totalPixels;
+        double variance = sumSquares / features.totalPixels - features.mean * features.mean;
+        features.stddev = std::sqrt(std::max(0.0, variance));
+    }
+}
+
+// Helper function to compute histogram, mean and stddev in a single pass over the frame,
+// counting only pixels where the mask (if any) is non-zero
+void computeIntensityStats(const cv::Mat& gray, const cv::Mat& mask, FrameFeatures& features) {
+    StageTimer timer(Stage::Histogram);
+    auto accumulateRows = [&](int begin, int end, HistogramAccumulator& histogram) {
+        for (int y = begin; y < end; y++) {
+            accumulateHistogramRow(gray.ptr<uchar>(y), mask.empty() ? nullptr : mask.ptr<uchar>(y), 0, gray.cols,
+                                   histogram);
+        }
+    };
+
+    size_t stripes = rowStripeCount(gray.rows);
+    if (stripes <= 1) {
+        HistogramAccumulator histogram;
+        accumulateRows(0, gray.rows, histogram);
+        histogram.mergeInto(features.histogram);
+    } else {
+        std::vector<HistogramAccumulator> partial(stripes);
+        forEachRowStripe(gray.rows, stripes, [&](size_t stripe, int begin, int end) {
+            accumulateRows(begin, end, partial[stripe]);
+        });
+        for (size_t i = 1; i < stripes; i++) {
+            partial[0].add(partial[i]);
+        }
+        partial[0].mergeInto(features.histogram);
+    }
+    finalizeIntensityStats(features);
+}
+
+// Helper function to accumulate the Laplacian response (and optionally strong Sobel gradients)
+// inside the mask without materialising either response image
+LaplacianSums computeLaplacianSums(const cv::Mat& gray, const cv::Mat& mask, int gradientThreshold = 0) {
+    StageTimer timer(Stage::Laplacian);
+    size_t stripes = rowStripeCount(gray.rows);
+    LaplacianSums partial[16];
+    std::vector<LaplacianSums> extra;
+    LaplacianSums* stripeSums = partial;
+    if (stripes > 16) {
+        extra.resize(stripes);
+        stripeSums = extra.data();
+    }
+
+    forEachRowStripe(gray.rows, stripes, [&](size_t stripe, int begin, int end) {
+        for (int y = begin; y < end; y++) {
+            accumulateLaplacianRow(gray.ptr<uchar>(reflect101(y - 1, gray.rows)), gray.ptr<uchar>(y),
+                                   gray.ptr<uchar>(reflect101(y + 1, gray.rows)),
+                                   mask.empty() ? nullptr : mask.ptr<uchar>(y), gray.cols, 0, gray.cols,
+                                   stripeSums[stripe], gradientThreshold);
+        }
+    });
+
+    LaplacianSums sums;
+    for (size_t i = 0; i < stripes; i++) {
+        sums.add(stripeSums[i]);
+    }
+    return sums;
+}
+
+// Helper function to compute the variance of the Laplacian response inside the mask;
+// matches cv::Laplacian(CV_64F) followed by cv::meanStdDev
+double computeLaplacianVariance(const cv::Mat& gray, const cv::Mat& mask = cv::Mat()) {
+    return computeLaplacianSums(gray, mask).variance();
+}
+
+// Gradient edge estimator calibration. The threshold is Canny's high threshold on the same
+// L1 Sobel magnitude. Without non-maximum suppression a sharp step edge crosses it on the
+// two pixels straddling the step, where Canny keeps one, so each strong pixel counts half.
+const int kGradientEdgeThreshold = 150;
+const double kGradientEdgeWeight = 0.5;
+
+// Helper function to estimate the number of Canny edge pixels from strong gradient counts
+double gradientEdgeCount(const LaplacianSums& sums) {
+    return sums.strongGradients * kGradientEdgeWeight;
+}
+
+// Helper function to compute the fraction of Canny edge pixels inside the mask
+double computeEdgeDensity(const cv::Mat& gray, const cv::Mat& mask = cv::Mat()) {
+    StageTimer timer(Stage::Edges);
+    ScratchArena::Scope scratch;
+    cv::Mat& edges = scratch.arena().image(ScratchImage::Edges);
+    cv::Canny(gray, edges, 50, 150);
+    if (mask.empty()) {
+        return cv::countNonZero(edges) / (double)(edges.rows * edges.cols);
+    }
+    cv::Mat& maskedEdges = scratch.arena().image(ScratchImage::MaskedEdges);
+    cv::bitwise_and(edges, mask, maskedEdges);
+    return cv::countNonZero(maskedEdges) / (double)cv::countNonZero(mask);
+}
+
+// Helper function to compute the shared features needed by the selected metrics. Frames
+// analysed at reduced resolution are corrected towards full-resolution values with a
+// heuristic: Laplacian variance divided by s^2, edge density by s (edges are 1-D curves, so
+// they cover s times more of the remaining pixels). The correction is approximate, not an
+// equivalence. Area and DCT downsampling low-pass the frame, so the Laplacian energy grows by
+// less than s^2 by an amount that depends on the scene. Histogram statistics are
+// area-normalised and need no correction.
+// Features are computed in two stages: the cheap histogram stage and the structure stage
+// (Laplacian, edges) that touches every pixel's neighbourhood.
+void computeHistogramStage(const cv::Mat& gray, const cv::Mat& mask, uint32_t metrics, FrameFeatures& features) {
+    if (metrics & (kMetricBlackout | kMetricFlash | kMetricSmear)) {
+        computeIntensityStats(gray, mask, features);
+        features.hasIntensityStats = true;
+    }
+}
+
+void computeStructureStage(const cv::Mat& gray, const cv::Mat& mask, int analysisScale, uint32_t metrics,
+                           FrameFeatures& features, EdgeEstimator edgeEstimator) {
+    // The gradient estimator is evaluated inside the Laplacian pass
+    bool gradientEdges = (metrics & kMetricSmear) && edgeEstimator == EdgeEstimator::Gradient;
+    if (metrics & (kMetricDefocus | kMetricSmear)) {
+        LaplacianSums sums = computeLaplacianSums(gray, mask, gradientEdges ? kGradientEdgeThreshold : 0);
+        features.laplacianVariance = sums.variance() / (analysisScale * analysisScale);
+        features.hasLaplacian = true;
+        if (gradientEdges) {
+            features.edgeDensity = sums.pixels > 0 ? gradientEdgeCount(sums) / sums.pixels / analysisScale : 0.0;
+            features.hasEdges = true;
+        }
+    }
+    if ((metrics & kMetricSmear) && !gradientEdges) {
+        features.edgeDensity = computeEdgeDensity(gray, mask) / analysisScale;
+        features.hasEdges = true;
+    }
+}
+
+const cv::Mat& FramePyramid::level(int i) {
+    while (static_cast<int>(levels_.size()) <= i) {
+        StageTimer timer(Stage::Laplacian);
+        ScratchArena::Scope scratch;
+        int slot = static_cast<int>(ScratchImage::Pyramid1) + static_cast<int>(levels_.size()) - 1;
+        cv::Mat& next = scratch.arena().image(static_cast<ScratchImage>(slot));
+        cv::pyrDown(levels_.back(), next);
+        levels_.push_back(next);
+    }
+    return levels_[i];
+}
+
+// Smallest side of a pyramid level worth a Laplacian estimate
+const int kMinPyramidSide = 16;
+
+// Pyramid variant of the structure stage. Each level's Laplacian variance is corrected towards
+// full resolution with the approximate rescaling of computeStructureStage (level i is analysed
+// at scale analysisScale * 2^i) and the median of those estimates feeds defocus and smear. Sensor noise
+// inflates mostly the finest level, since every pyrDown low-passes it away, while fine focus
+// loss shows at the finer levels first; the median tracks the levels that agree. Smear edges
+// are taken from level 1, a quarter of the pixels of the analysis frame.
+void computePyramidStructureStage(FramePyramid& pyramid, const cv::Mat& mask, int analysisScale, uint32_t metrics,
+                                  int levels, FrameFeatures& features, EdgeEstimator edgeEstimator) {
+    const cv::Mat& gray = pyramid.level(0);
+    int usable = 1;
+    while (usable < std::min(levels, kMaxPyramidLevels) && (gray.cols >> usable) >= kMinPyramidSide &&
+           (gray.rows >> usable) >= kMinPyramidSide) {
+        usable++;
+    }
+    int edgeLevel = std::min(1, usable - 1);
+    double edgeScale = static_cast<double>(analysisScale << edgeLevel);
+
+    ScratchArena::Scope scratch;
+    cv::Mat& levelMask = scratch.arena().image(ScratchImage::PyramidMask);
+    auto maskFor = [&](const cv::Mat& level) -> const cv::Mat& {
+        if (mask.empty() || mask.size() == level.size()) return mask;
+        cv::resize(mask, levelMask, level.size(), 0, 0, cv::INTER_NEAREST);
+        return levelMask;
+    };
+
+    bool gradientEdges = (metrics & kMetricSmear) && edgeEstimator == EdgeEstimator::Gradient;
+    if (metrics & (kMetricDefocus | kMetricSmear)) {
+        double estimates[kMaxPyramidLevels];
+        for (int i = 0; i < usable; i++) {
+            const cv::Mat& level = pyramid.level(i);
+            // The gradient estimator rides on the Laplacian pass of the edge level
+            bool countEdges = gradientEdges && i == edgeLevel;
+            LaplacianSums sums = computeLaplacianSums(level, maskFor(level), countEdges ? kGradientEdgeThreshold : 0);
+            double scale = static_cast<double>(analysisScale << i);
+            estimates[i] = sums.variance() / (scale * scale);
+            if (countEdges) {
+                features.edgeDensity = sums.pixels > 0 ? gradientEdgeCount(sums) / sums.pixels / edgeScale : 0.0;
+                features.hasEdges = true;
+            }
+        }
+        std::sort(estimates, estimates + usable);
+        features.laplacianVariance = usable % 2 ? estimates[usable / 2]
+                                                : (estimates[usable / 2 - 1] + estimates[usable / 2]) / 2.0;
+        features.hasLaplacian = true;
+    }
+    if ((metrics & kMetricSmear) && !gradientEdges) {
+        const cv::Mat& level = pyramid.level(edgeLevel);
+        features.edgeDensity = computeEdgeDensity(level, maskFor(level)) / edgeScale;
+        features.hasEdges = true;
+    }
+}
+
+FrameFeatures computeFrameFeatures(const cv::Mat& gray, int analysisScale, uint32_t metrics,
+                                   const cv::Mat& mask) {
+    FrameFeatures features;
+    computeHistogramStage(gray, mask, metrics, features);
+    computeStructureStage(gray, mask, analysisScale, metrics, features);
+    return features;
+}
+
+// Per-tile sums filled by the fused grid traversal
+struct TileAccumulator {
+    HistogramAccumulator histogram;
+    uint64_t pixels = 0;
+    LaplacianSums laplacian;
+    uint64_t edgePixels = 0;
+
+    void add(const TileAccumulator& other) {
+        histogram.add(other.histogram);
+        pixels += other.pixels;
+        laplacian.add(other.laplacian);
+        edgePixels += other.edgePixels;
+    }
+};
+
+// Helper function to accumulate histogram, Laplacian sums and edge counts for a
+// rows x cols tile grid in one traversal of the frame. Each row is processed tile by
+// tile with the same row kernels as the full-frame path, so no full-frame intermediate
+// is written. Edge counts are read from an optional edge map; strong gradients are counted
+// in the Laplacian pass when gradientThreshold is positive.
+void accumulateTiles(const cv::Mat& gray, const cv::Mat& mask, const cv::Mat& edges,
+                     bool withHistogram, bool withLaplacian, int gradientThreshold, int rows, int cols,
+                     std::vector<TileAccumulator>& tiles) {
+    StageTimer timer(Stage::Grid);
+    tiles.assign(static_cast<size_t>(rows) * cols, TileAccumulator());
+    // Tile c covers columns [columnStart[c], columnStart[c + 1]), tile row r pixel rows
+    // [rowStart(r), rowStart(r + 1)); grids have at most 16 columns
+    int columnStart[17];
+    for (int c = 0; c <= cols; c++) {
+        columnStart[c] = static_cast<int>((static_cast<int64_t>(c) * gray.cols + cols - 1) / cols);
+    }
+    auto rowStart = [&](int r) { return static_cast<int>((static_cast<int64_t>(r) * gray.rows + rows - 1) / rows); };
+
+    // Stripes are whole tile rows, so parallel stripes never share a tile
+    size_t stripes = std::min(rowStripeCount(gray.rows), static_cast<size_t>(rows));
+    forEachRowStripe(rows, stripes, [&](size_t, int tileRowBegin, int tileRowEnd) {
+        for (int y = rowStart(tileRowBegin); y < rowStart(tileRowEnd); y++) {
+            TileAccumulator* rowTiles = &tiles[static_cast<size_t>(static_cast<int64_t>(y) * rows / gray.rows) * cols];
+            const uchar* row = gray.ptr<uchar>(y);
+            const uchar* up = gray.ptr<uchar>(reflect101(y - 1, gray.rows));
+            const uchar* down = gray.ptr<uchar>(reflect101(y + 1, gray.rows));
+            const uchar* maskRow = mask.empty() ? nullptr : mask.ptr<uchar>(y);
+            const uchar* edgeRow = edges.empty() ? nullptr : edges.ptr<uchar>(y);
+
+            for (int c = 0; c < cols; c++) {
+                TileAccumulator& tile = rowTiles[c];
+                int from = columnStart[c], to = columnStart[c + 1];
+                if (withHistogram) {
+                    accumulateHistogramRow(row, maskRow, from, to, tile.histogram);
+                }
+                if (withLaplacian) {
+                    accumulateLaplacianRow(up, row, down, maskRow, gray.cols, from, to, tile.laplacian,
+                                           gradientThreshold);
+                }
+                if (!maskRow) {
+                    tile.pixels += to - from;
+                    if (edgeRow) {
+                        for (int x = from; x < to; x++) tile.edgePixels += edgeRow[x] != 0;
+                    }
+                } else {
+                    for (int x = from; x < to; x++) {
+                        if (!maskRow[x]) continue;
+                        tile.pixels++;
+                        if (edgeRow && edgeRow[x]) tile.edgePixels++;
+                    }
+                }
+            }
+        }
+    });
+}
+
+// Helper function to turn one tile's (or the merged grid's) sums into features
+FrameFeatures featuresFromTile(const TileAccumulator& tile, bool withHistogram, bool withLaplacian,
+                               bool withEdges, bool gradientEdges, int analysisScale) {
+    FrameFeatures features;
+    features.totalPixels = static_cast<double>(tile.pixels);
+    if (withHistogram) {
+        tile.histogram.mergeInto(features.histogram);
+        finalizeIntensityStats(features);
+        features.hasIntensityStats = true;
+    }
+    if (withLaplacian && tile.pixels > 0) {
+        features.laplacianVariance = tile.laplacian.variance() / (analysisScale * analysisScale);
+        features.hasLaplacian = true;
+    }
+    if (withEdges && tile.pixels > 0) {
+        double edgePixels = gradientEdges ? gradientEdgeCount(tile.laplacian) : tile.edgePixels;
+        features.edgeDensity = edgePixels / tile.pixels / analysisScale;
+        features.hasEdges = true;
+    }
+    return features;
+}
+
+// Arenas of all live threads, for the memory query and release. Intentionally leaked so
+// threads exiting during shutdown can still unregister.
+struct ScratchRegistry {
+    std::mutex mutex;
+    std::vector<ScratchArena*> arenas;
+};
+
+ScratchRegistry& scratchRegistry() {
+    static ScratchRegistry* registry = new ScratchRegistry();
+    return *registry;
+}
+
+ScratchArena::ScratchArena() {
+    ScratchRegistry& registry = scratchRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.arenas.push_back(this);
+}
+
+ScratchArena::~ScratchArena() {
+    ScratchRegistry& registry = scratchRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.arenas.erase(std::remove(registry.arenas.begin(), registry.arenas.end(), this), registry.arenas.end());
+}
+
+ScratchArena& ScratchArena::local() {
+    thread_local ScratchArena arena;
+    return arena;
+}
+
+// Helper function to tell whether a pooled Mat is still referenced outside the arena
+bool sharedWithCaller(const cv::Mat& image) {
+    return image.u != nullptr && image.u->refcount > 1;
+}
+
+cv::Mat& ScratchArena::image(ScratchImage which) {
+    cv::Mat& image = images_[static_cast<int>(which)];
+    if (sharedWithCaller(image)) image.release();
+    return image;
+}
+
+cv::Mat& ScratchArena::decodeTarget() {
+    for (cv::Mat& slot : decoded_) {
+        if (!sharedWithCaller(slot)) return slot;
+    }
+    decoded_[0].release();
+    return decoded_[0];
+}
+
+size_t ScratchArena::bytes() {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    size_t total = tiles_.capacity() * sizeof(TileAccumulator);
+    for (const cv::Mat& image : images_) {
+        if (!image.empty()) total += image.step[0] * image.rows;
+    }
+    for (const cv::Mat& image : decoded_) {
+        if (!image.empty()) total += image.step[0] * image.rows;
+    }
+    for (const cv::UMat& image : deviceImages_) {
+        total += image.total() * image.elemSize();
+    }
+    return total + deviceMask_.total() * deviceMask_.elemSize();
+}
+
+size_t ScratchArena::release() {
+    size_t freed = bytes();
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    for (cv::Mat& image : images_) image.release();
+    for (cv::Mat& image : decoded_) image.release();
+    std::vector<TileAccumulator>().swap(tiles_);
+    for (cv::UMat& image : deviceImages_) image.release();
+    deviceMaskSource_.release();
+    deviceMask_.release();
+    return freed;
+}
+
+const cv::UMat& ScratchArena::deviceMask(const cv::Mat& mask, double& maskPixels) {
+    // Holding the source keeps its buffer alive, so an equal data pointer means the same mask
+    if (mask.data != deviceMaskSource_.data) {
+        mask.copyTo(deviceMask_);
+        deviceMaskSource_ = mask;
+        deviceMaskPixels_ = cv::countNonZero(mask);
+    }
+    maskPixels = deviceMaskPixels_;
+    return deviceMask_;
+}
+
+size_t ScratchArena::totalBytes(size_t* arenaCount) {
+    ScratchRegistry& registry = scratchRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    size_t total = 0;
+    for (ScratchArena* arena : registry.arenas) {
+        total += arena->bytes();
+    }
+    if (arenaCount) *arenaCount = registry.arenas.size();
+    return total;
+}
+
+size_t ScratchArena::releaseAll() {
+    ScratchRegistry& registry = scratchRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    size_t freed = 0;
+    for (ScratchArena* arena : registry.arenas) {
+        freed += arena->release();
+    }
+    return freed;
+}
+
+// Helper function to calculate defocus score
+double calculateDefocusScore(const FrameFeatures& features) {
+    return 100.0 - std::min(100.0, features.laplacianVariance / 10.0);
+}
+
+// Helper function to calculate blackout score
+double calculateBlackoutScore(const FrameFeatures& features) {
+    double avgIntensity = features.mean;
+
+    // Calculate percentage of dark pixels
+    double darkPixels = histogramRange(features, 0, 75);  // Count pixels with intensity 0-74
+    double darkPercentage = (darkPixels / features.totalPixels) * 100.0;
+
+    // Moderately sensitive blackout detection
+    // Detect blackout when average intensity is below 60
+    // and there's a moderate percentage of dark pixels
+    double intensityScore = std::max(0.0, (60.0 - avgIntensity) * 1.5);
+    double darkPixelScore = darkPercentage * 0.6;
+    return std::min(100.0, intensityScore + darkPixelScore);
+}
+
+// Helper function to calculate flash score
+double calculateFlashScore(const FrameFeatures& features) {
+    // Calculate percentage of bright pixels
+    double highIntensityPixels = histogramRange(features, 200, 256);
+    double brightPercentage = (highIntensityPixels / features.totalPixels) * 100.0;
+
+    // Convert to 0-100 scale where higher means more flash
+    return std::min(100.0, std::max(0.0, brightPercentage * 3.0));
+}
+
+// Helper function to calculate smear score
+double calculateSmearScore(const FrameFeatures& features, double defocusScore) {
+    // Calculate global contrast and brightness
+    double brightness = features.mean;
+    double contrastScore = 100.0 - std::min(100.0, std::max(0.0, (features.stddev / 10.0) * 100.0));
+
+    // Calculate edge density
+    double edgeScore = 100.0 - std::min(100.0, features.edgeDensity * 150.0);
+
+    // Calculate percentage of different intensity ranges
+    double darkPercentage = (histogramRange(features, 0, 85) / features.totalPixels) * 100.0;
+    double midPercentage = (histogramRange(features, 85, 170) / features.totalPixels) * 100.0;
+    double brightPercentage = (histogramRange(features, 170, 256) / features.totalPixels) * 100.0;
+
+    // Calculate base characteristics score with adjusted weights
+    double baseScore = (defocusScore * 0.5) + (contrastScore * 0.3) + (edgeScore * 0.2);
+
+    // Calculate intensity distribution score with adjusted thresholds
+    double intensityScore = 0.0;
+
+    // Adjust thresholds based on overall brightness
+    double brightnessFactor = std::min(1.0, brightness / 120.0);
+    double darkThreshold = 8.0 + (brightnessFactor * 3.0);
+    double brightThreshold = 8.0 + ((1.0 - brightnessFactor) * 3.0);
+    double midThreshold = 15.0 + (brightnessFactor * 2.0);
+
+    // Increase sensitivity to bright conditions
+    if (brightness > 120.0) {
+        intensityScore += (brightness - 120.0) * 0.8;
+    }
+
+    if (darkPercentage > darkThreshold) intensityScore += darkPercentage * 0.5;
+    if (brightPercentage > brightThreshold) intensityScore += brightPercentage * 0.5;
+    if (midPercentage > midThreshold) intensityScore += midPercentage * 0.3;
+
+    // Calculate combined score
+    double combinedScore = baseScore + (intensityScore * 0.4);
+
+    // Invert the scoring logic - higher scores for smears, lower for normal images
+    if (combinedScore > 20.0) { // Lower threshold to catch more smears
+        // Give high scores for smears
+        return std::min(100.0, 20.0 + (combinedScore - 20.0) * 1.5);
+    }
+    // Give low scores for normal images
+    return combinedScore * 0.5;
+}
+
+// Helper function to calculate scene change score, averaged inside the mask if one is given
+double calculateSceneChangeScore(const cv::Mat& current, const cv::Mat& previous, const cv::Mat& mask,
+                                 Backend backend, const cv::UMat& deviceCurrent) {
+    if (previous.empty()) return 0.0;
+    StageTimer timer(Stage::SceneChange);
+    
+    ScratchArena::Scope scratch;
+    double avgDiff = 0.0;
+    if (backend == Backend::OpenCL && openclAvailable()) {
+        ScratchArena& arena = scratch.arena();
+        bool uploaded = !deviceCurrent.empty() && deviceCurrent.size() == current.size();
+        cv::UMat& deviceGray = arena.deviceImage(DeviceImage::Gray);
+        cv::UMat& devicePrevious = arena.deviceImage(DeviceImage::Previous);
+        cv::UMat& diff = arena.deviceImage(DeviceImage::Difference);
+        if (!uploaded) current.copyTo(deviceGray);
+        previous.copyTo(devicePrevious);
+        cv::absdiff(uploaded ? deviceCurrent : deviceGray, devicePrevious, diff);
+        double maskPixels = 0.0;
+        avgDiff = mask.empty() ? cv::mean(diff)[0] : cv::mean(diff, arena.deviceMask(mask, maskPixels))[0];
+    } else {
+        cv::Mat& diff = scratch.arena().image(ScratchImage::Difference);
+        cv::absdiff(current, previous, diff);
+        avgDiff = mask.empty() ? cv::mean(diff)[0] : cv::mean(diff, mask)[0];
+    }
+    
+    // Convert to 0-100 scale where higher means more change
+    // Assuming significant change starts at 50.0 difference
+    return std::min(100.0, std::max(0.0, (avgDiff / 50.0) * 100.0));
+}
+
+// OpenCL backend: the same stages on cv::UMat through OpenCV's transparent API. The frame
+// (and the mask, when it changes) is uploaded once and every stage reads the device copy;
+// only scalars and the 256-bin histogram are read back. Kernels match the CPU ones
+// (Laplacian ksize 1 and Sobel 3x3 with BORDER_REFLECT_101, Canny(50, 150)), so scores agree
+// up to floating-point summation order.
+bool openclAvailable() {
+    static const bool available = [] {
+        try {
+            if (!cv::ocl::haveOpenCL()) return false;
+            cv::ocl::setUseOpenCL(true);
+            return cv::ocl::useOpenCL();
+        }
+        catch (const cv::Exception&) {
+            return false;
+        }
+    }();
+    return available;
+}
+
+// Frame uploaded for the OpenCL stages, with the host copies it came from; the masks are
+// empty when the whole frame is analysed
+struct DeviceFrame {
+    const cv::Mat& hostGray;
+    const cv::Mat& hostMask;
+    const cv::UMat& gray;
+    const cv::UMat& mask;
+    double pixels;  // Analysed pixels
+};
+
+void computeHistogramStageOpenCL(const DeviceFrame& frame, uint32_t metrics, FrameFeatures& features) {
+    if (!(metrics & (kMetricBlackout | kMetricFlash | kMetricSmear))) return;
+    // OpenCV has no masked OpenCL histogram; the host copy avoids reading the frame back
+    if (!frame.hostMask.empty()) {
+        computeHistogramStage(frame.hostGray, frame.hostMask, metrics, features);
+        return;
+    }
+    StageTimer timer(Stage::Histogram);
+    cv::Mat hist;
+    cv::calcHist(std::vector<cv::UMat>{frame.gray}, {0}, frame.mask, hist, {256}, {0.0f, 256.0f});
+    for (int i = 0; i < 256; i++) {
+        features.histogram[i] = static_cast<uint32_t>(hist.at<float>(i));
+    }
+    finalizeIntensityStats(features);
+    features.hasIntensityStats = true;
+}
+
+// Helper function to count the mask-selected non-zero pixels of a device image
+double countSelected(ScratchArena& arena, const DeviceFrame& frame, const cv::UMat& image) {
+    if (frame.mask.empty()) return cv::countNonZero(image);
+    cv::UMat& masked = arena.deviceImage(DeviceImage::MaskedEdges);
+    cv::bitwise_and(image, frame.mask, masked);
+    return cv::countNonZero(masked);
+}
+
+void computeStructureStageOpenCL(const DeviceFrame& frame, int analysisScale, uint32_t metrics,
+                                 FrameFeatures& features, EdgeEstimator edgeEstimator) {
+    ScratchArena::Scope scratch;
+    ScratchArena& arena = scratch.arena();
+    bool gradientEdges = (metrics & kMetricSmear) && edgeEstimator == EdgeEstimator::Gradient;
+    if (metrics & (kMetricDefocus | kMetricSmear)) {
+        StageTimer timer(Stage::Laplacian);
+        cv::UMat& laplacian = arena.deviceImage(DeviceImage::Laplacian);
+        cv::Laplacian(frame.gray, laplacian, CV_16S, 1, 1, 0, cv::BORDER_REFLECT_101);
+        cv::Scalar mean, stddev;
+        cv::meanStdDev(laplacian, mean, stddev, frame.mask);
+        features.laplacianVariance = stddev[0] * stddev[0] / (analysisScale * analysisScale);
+        features.hasLaplacian = true;
+    }
+    if (!(metrics & kMetricSmear) || frame.pixels <= 0) {
+        features.hasEdges = (metrics & kMetricSmear) != 0;
+        return;
+    }
+
+    StageTimer timer(Stage::Edges);
+    cv::UMat& edges = arena.deviceImage(DeviceImage::Edges);
+    if (gradientEdges) {
+        cv::UMat& gx = arena.deviceImage(DeviceImage::GradientX);
+        cv::UMat& gy = arena.deviceImage(DeviceImage::GradientY);
+        cv::UMat& magnitude = arena.deviceImage(DeviceImage::Gradient);
+        cv::Sobel(frame.gray, gx, CV_16S, 1, 0, 3, 1, 0, cv::BORDER_REFLECT_101);
+        cv::Sobel(frame.gray, gy, CV_16S, 0, 1, 3, 1, 0, cv::BORDER_REFLECT_101);
+        cv::absdiff(gx, cv::Scalar::all(0), gx);
+        cv::absdiff(gy, cv::Scalar::all(0), gy);
+        cv::add(gx, gy, magnitude);
+        cv::compare(magnitude, cv::Scalar::all(kGradientEdgeThreshold), edges, cv::CMP_GE);
+        features.edgeDensity = countSelected(arena, frame, edges) * kGradientEdgeWeight / frame.pixels / analysisScale;
+    } else {
+        cv::Canny(frame.gray, edges, 50, 150);
+        features.edgeDensity = countSelected(arena, frame, edges) / frame.pixels / analysisScale;
+    }
+    features.hasEdges = true;
+}
+
+// Helper function to turn features into the selected scores; unselected scores are NaN
+SabotageScores scoresFromFeatures(const FrameFeatures& features, uint32_t metrics) {
+    double nan = std::numeric_limits<double>::quiet_NaN();
+    SabotageScores scores;
+    scores.metrics = metrics & (kMetricDefocus | kMetricBlackout | kMetricFlash | kMetricSmear);
+    double defocusScore = features.hasLaplacian ? calculateDefocusScore(features) : nan;
+    scores.defocusScore = (metrics & kMetricDefocus) ? defocusScore : nan;
+    scores.blackoutScore = (metrics & kMetricBlackout) ? calculateBlackoutScore(features) : nan;
+    scores.flashScore = (metrics & kMetricFlash) ? calculateFlashScore(features) : nan;
+    scores.smearScore = (metrics & kMetricSmear) ? calculateSmearScore(features, defocusScore) : nan;
+    return scores;
+}
+
+// Helper function to score a frame in grid mode. Every tile's histogram, Laplacian sums
+// and edge count come from a single fused traversal; the frame-level scores are derived
+// by merging the tile sums, so they need no extra pass either.
+SabotageScores computeGridScores(const cv::Mat& gray, const cv::Mat& mask, const AnalysisOptions& options) {
+    uint32_t metrics = options.metrics;
+    bool withHistogram = (metrics & (kMetricBlackout | kMetricFlash | kMetricSmear)) != 0;
+    bool withLaplacian = (metrics & (kMetricDefocus | kMetricSmear)) != 0;
+    bool withEdges = (metrics & kMetricSmear) != 0;
+    bool gradientEdges = withEdges && options.edgeEstimator == EdgeEstimator::Gradient;
+
+    ScratchArena::Scope scratch;
+    cv::Mat noEdges;
+    cv::Mat& edges = (withEdges && !gradientEdges) ? scratch.arena().image(ScratchImage::Edges) : noEdges;
+    if (&edges != &noEdges) {
+        StageTimer timer(Stage::Edges);
+        cv::Canny(gray, edges, 50, 150);
+    }
+
+    std::vector<TileAccumulator>& tiles = scratch.arena().tiles();
+    accumulateTiles(gray, mask, edges, withHistogram, withLaplacian, gradientEdges ? kGradientEdgeThreshold : 0,
+                    options.gridRows, options.gridCols, tiles);
+
+    TileAccumulator merged;
+    for (const TileAccumulator& tile : tiles) {
+        merged.add(tile);
+    }
+    SabotageScores scores = scoresFromFeatures(
+        featuresFromTile(merged, withHistogram, withLaplacian, withEdges, gradientEdges, options.analysisScale), metrics);
+
+    double nan = std::numeric_limits<double>::quiet_NaN();
+    std::shared_ptr<TileGridScores> grid = std::make_shared<TileGridScores>();
+    grid->rows = options.gridRows;
+    grid->cols = options.gridCols;
+    grid->tiles.reserve(tiles.size());
+    grid->max.metrics = scores.metrics;
+    grid->max.defocusScore = grid->max.blackoutScore = grid->max.flashScore = grid->max.smearScore = nan;
+    for (const TileAccumulator& tile : tiles) {
+        SabotageScores tileScores;
+        if (tile.pixels > 0) {
+            tileScores = scoresFromFeatures(
+                featuresFromTile(tile, withHistogram, withLaplacian, withEdges, gradientEdges, options.analysisScale), metrics);
+        } else {
+            // Tiles entirely outside the analysis region have no scores
+            tileScores.metrics = scores.metrics;
+            tileScores.defocusScore = tileScores.blackoutScore = tileScores.flashScore = tileScores.smearScore = nan;
+        }
+        // std::fmax ignores NaN, so empty tiles and unselected metrics do not affect the maximum
+        grid->max.defocusScore = std::fmax(grid->max.defocusScore, tileScores.defocusScore);
+        grid->max.blackoutScore = std::fmax(grid->max.blackoutScore, tileScores.blackoutScore);
+        grid->max.flashScore = std::fmax(grid->max.flashScore, tileScores.flashScore);
+        grid->max.smearScore = std::fmax(grid->max.smearScore, tileScores.smearScore);
+        grid->tiles.push_back(tileScores);
+    }
+    scores.grid = grid;
+    return scores;
+}
+
+// Helper function to run the two feature stages with the cascade between them and turn the
+// features into scores. The stages are given by the backend.
+SabotageScores scoreStages(const AnalysisOptions& options,
+                           const std::function<void(uint32_t, FrameFeatures&)>& histogramStage,
+                           const std::function<void(uint32_t, FrameFeatures&)>& structureStage) {
+    double nan = std::numeric_limits<double>::quiet_NaN();
+    uint32_t metrics = options.metrics;
+    FrameFeatures features;
+
+    // The cascade decides from blackout and flash, so it always needs the histogram stage
+    uint32_t histogramMetrics = options.cascade ? (metrics | kMetricBlackout | kMetricFlash) : metrics;
+    histogramStage(histogramMetrics, features);
+    double blackoutScore = features.hasIntensityStats ? calculateBlackoutScore(features) : nan;
+    double flashScore = features.hasIntensityStats ? calculateFlashScore(features) : nan;
+
+    // An obviously covered or flashed lens needs no structure analysis
+    bool shortCircuited = options.cascade &&
+        (blackoutScore >= options.cascadeThreshold || flashScore >= options.cascadeThreshold);
+    if (shortCircuited) {
+        metrics &= ~(kMetricDefocus | kMetricSmear);
+    }
+    structureStage(metrics, features);
+
+    SabotageScores scores = scoresFromFeatures(features, metrics);
+    scores.shortCircuited = shortCircuited;
+    return scores;
+}
+
+// Helper function to calculate the selected sabotage scores for a grayscale frame.
+// Scores that were not selected (or were skipped by the cascade) are left as NaN.
+SabotageScores computeSabotageScores(const cv::Mat& gray, const AnalysisOptions& options, FramePyramid* pyramid,
+                                     cv::UMat* deviceGray) {
+    cv::Mat mask = options.resolveMask(gray);
+    if (options.gridRows > 0) {
+        return computeGridScores(gray, mask, options);
+    }
+
+    if (options.defocusEstimator == DefocusEstimator::Pyramid) {
+        FramePyramid local;
+        FramePyramid& levels = pyramid ? *pyramid : local;
+        if (levels.empty()) levels.reset(gray);
+        return scoreStages(options,
+            [&](uint32_t metrics, FrameFeatures& features) {
+                computeHistogramStage(gray, mask, metrics, features);
+            },
+            [&](uint32_t metrics, FrameFeatures& features) {
+                computePyramidStructureStage(levels, mask, options.analysisScale, metrics, options.pyramidLevels,
+                                             features, options.edgeEstimator);
+            });
+    }
+
+    if (options.backend == Backend::OpenCL && openclAvailable()) {
+        ScratchArena::Scope scratch;
+        cv::UMat& uploaded = scratch.arena().deviceImage(DeviceImage::Gray);
+        gray.copyTo(uploaded);
+        if (deviceGray) *deviceGray = uploaded;
+        double pixels = static_cast<double>(gray.total());
+        cv::UMat noMask;
+        const cv::UMat& deviceMask = mask.empty() ? noMask : scratch.arena().deviceMask(mask, pixels);
+        DeviceFrame frame{gray, mask, uploaded, deviceMask, pixels};
+        return scoreStages(options,
+            [&](uint32_t metrics, FrameFeatures& features) {
+                computeHistogramStageOpenCL(frame, metrics, features);
+            },
+            [&](uint32_t metrics, FrameFeatures& features) {
+                computeStructureStageOpenCL(frame, options.analysisScale, metrics, features, options.edgeEstimator);
+            });
+    }
+
+    return scoreStages(options,
+        [&](uint32_t metrics, FrameFeatures& features) {
+            computeHistogramStage(gray, mask, metrics, features);
+        },
+        [&](uint32_t metrics, FrameFeatures& features) {
+            computeStructureStage(gray, mask, options.analysisScale, metrics, features, options.edgeEstimator);
+        });
+}
+
+// Helper function to restrict options to the smear stage; the cascade is disabled because
+// it could skip the only requested score
+AnalysisOptions smearOnlyOptions(AnalysisOptions options) {
+    options.metrics = kMetricSmear;
+    options.cascade = false;
+    return options;
+}
+
+void AlertFilter::reset() {
+    for (Track& track : tracks_) {
+        track.ema = std::numeric_limits<double>::quiet_NaN();
+        track.above = track.below = 0;
+    }
+    active_ = 0;
+}
+
+// Helper function to count the set bits of a frame history or hash
+int countBits(uint64_t bits) {
+    int count = 0;
+    for (; bits != 0; bits &= bits - 1) count++;
+    return count;
+}
+
+AlertState AlertFilter::update(const double scores[kMetricCount]) {
+    uint32_t window = options_.window >= 32 ? ~0u : (1u << options_.window) - 1;
+    AlertState state;
+    uint32_t previous = active_;
+    for (int i = 0; i < kMetricCount; i++) {
+        Track& track = tracks_[i];
+        if (!std::isnan(scores[i])) {
+            track.ema = std::isnan(track.ema) ? scores[i] : track.ema + options_.alpha * (scores[i] - track.ema);
+            double threshold = options_.thresholds[i];
+            track.above = ((track.above << 1) | (track.ema >= threshold ? 1u : 0u)) & window;
+            track.below = ((track.below << 1) | (track.ema < threshold - options_.hysteresis ? 1u : 0u)) & window;
+
+            uint32_t bit = 1u << i;
+            if (!(active_ & bit) && countBits(track.above) >= options_.required) {
+                active_ |= bit;
+            } else if ((active_ & bit) && countBits(track.below) >= options_.required) {
+                active_ &= ~bit;
+            }
+        }
+        state.smoothed[i] = track.ema;
+    }
+    state.active = active_;
+    state.changed = active_ ^ previous;
+    return state;
+}
+
+void AnalysisBudget::configure(double millisecondsPerSecond) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    rate_ = millisecondsPerSecond;
+    tokens_ = millisecondsPerSecond;
+    last_ = std::chrono::steady_clock::now();
+}
+
+double AnalysisBudget::millisecondsPerSecond() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return rate_;
+}
+
+void AnalysisBudget::refill(std::chrono::steady_clock::time_point now) {
+    double seconds = std::chrono::duration<double>(now - last_).count();
+    tokens_ = std::min(rate_, tokens_ + rate_ * seconds);
+    last_ = now;
+}
+
+bool AnalysisBudget::available() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (rate_ <= 0.0) return true;
+    refill(std::chrono::steady_clock::now());
+    return tokens_ > 0.0;
+}
+
+void AnalysisBudget::charge(double milliseconds) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (rate_ <= 0.0) return;
+    refill(std::chrono::steady_clock::now());
+    // Debt is capped at one second so a burst of changes cannot starve stable cameras for long
+    tokens_ = std::max(-rate_, tokens_ - milliseconds);
+}
+
+AnalysisBudget& sharedAnalysisBudget() {
+    static AnalysisBudget budget;
+    return budget;
+}
+
+// Helper function to shrink a frame to the sampling thumbnail
+cv::Mat samplingThumbnail(const cv::Mat& gray, int width) {
+    if (gray.cols <= width) return gray.clone();
+    int height = std::max(1, static_cast<int>(std::lround(static_cast<double>(gray.rows) * width / gray.cols)));
+    cv::Mat thumbnail;
+    cv::resize(gray, thumbnail, cv::Size(width, height), 0, 0, cv::INTER_AREA);
+    return thumbnail;
+}
+
+// Helper function to decide, under the session lock, whether a frame gets the full analysis.
+// Changed frames always do; stable frames once every interval frames, budget permitting.
+bool SessionScorer::shouldAnalyze(const cv::Mat& thumbnail, double& changeScore) {
+    const SamplingOptions& sampling = options_.sampling;
+    if (hasScores_ && referenceThumbnail_.size() == thumbnail.size()) {
+        cv::Mat diff;
+        cv::absdiff(thumbnail, referenceThumbnail_, diff);
+        // Same scale as calculateSceneChangeScore
+        changeScore = std::min(100.0, cv::mean(diff)[0] / 50.0 * 100.0);
+        if (changeScore < sampling.changeThreshold) {
+            if (++sinceAnalysis_ < interval_ || !sharedAnalysisBudget().available()) return false;
+            interval_ = std::min(interval_ * 2, sampling.maxInterval);
+        } else {
+            interval_ = 1;
+        }
+    } else {
+        interval_ = 1;
+    }
+    sinceAnalysis_ = 0;
+    referenceThumbnail_ = thumbnail;
+    return true;
+}
+
+FrameHash frameHash(const cv::Mat& gray, int brightnessBits) {
+    cv::Mat thumbnail;
+    cv::resize(gray, thumbnail, cv::Size(9, 8), 0, 0, cv::INTER_AREA);
+    FrameHash hash;
+    int sum = 0;
+    for (int y = 0; y < 8; y++) {
+        const uchar* row = thumbnail.ptr<uchar>(y);
+        for (int x = 0; x < 8; x++) {
+            hash.bits = (hash.bits << 1) | (row[x] > row[x + 1] ? 1u : 0u);
+            sum += row[x];
+        }
+        sum += row[8];
+    }
+    hash.brightness = (sum / 72) >> (8 - std::max(0, std::min(8, brightnessBits)));
+    return hash;
+}
+
+int hashDistance(uint64_t a, uint64_t b) {
+    return countBits(a ^ b);
+}
+
+// Helper function to track, under the session lock, how long the hash has stayed constant
+// and to fill the frame from the closest cache entry of the same brightness within maxDistance.
+// Returns true on a hit.
+bool SessionScorer::lookupHash(const FrameHash& hash, SessionFrame& frame) {
+    const DedupOptions& dedup = options_.dedup;
+    bool identical = hash.bits == lastHash_.bits && hash.brightness == lastHash_.brightness;
+    identicalFrames_ = (identicalFrames_ >= 0 && identical) ? identicalFrames_ + 1 : 0;
+    lastHash_ = hash;
+    frame.frozenScore = std::min(100.0, 100.0 * identicalFrames_ / dedup.frozenFrames);
+
+    CacheEntry* best = nullptr;
+    int bestDistance = dedup.maxDistance + 1;
+    for (CacheEntry& entry : cache_) {
+        if (entry.hash.brightness != hash.brightness) continue;
+        int distance = hashDistance(hash.bits, entry.hash.bits);
+        if (distance < bestDistance) {
+            best = &entry;
+            bestDistance = distance;
+        }
+    }
+    if (!best) return false;
+    best->lastUsed = ++cacheClock_;
+    frame.scores = best->scores;
+    frame.cached = true;
+    return true;
+}
+
+// Helper function to store an analysed frame's scores, evicting the least recently used entry
+void SessionScorer::cacheScores(const FrameHash& hash, const SabotageScores& scores) {
+    CacheEntry entry{hash, ++cacheClock_, scores};
+    if (cache_.size() < static_cast<size_t>(options_.dedup.cacheSize)) {
+        cache_.push_back(entry);
+        return;
+    }
+    auto oldest = std::min_element(cache_.begin(), cache_.end(), [](const CacheEntry& a, const CacheEntry& b) {
+        return a.lastUsed < b.lastUsed;
+    });
+    *oldest = entry;
+}
+
+// Helper function to get the pyramid level that is scale times smaller than the analysis
+// frame, or null if scale is not a power of two within the pyramid
+const cv::Mat* pyramidLevelForScale(FramePyramid& pyramid, int scale) {
+    for (int i = 0; i < kMaxPyramidLevels; i++) {
+        if ((1 << i) == scale) return &pyramid.level(i);
+    }
+    return nullptr;
+}
+
+SessionFrame SessionScorer::analyze(const cv::Mat& gray) {
+    SessionFrame frame;
+    bool analyzeFrame = true;
+    FrameHash hash;
+    cv::UMat deviceGray;  // The frame as uploaded for the OpenCL stages, reused by scene change
+
+    // With the pyramid estimator the hash, the sampling thumbnail and the background grid are
+    // taken from the coarse levels the structure stage builds anyway
+    FramePyramid pyramid;
+    bool withPyramid = options_.analysis.defocusEstimator == DefocusEstimator::Pyramid;
+    const cv::Mat* coarse = &gray;
+    if (withPyramid) {
+        pyramid.reset(gray);
+        coarse = &pyramid.level(std::min(2, options_.analysis.pyramidLevels - 1));
+    }
+
+    if (options_.dedup.enabled) {
+        hash = frameHash(*coarse, options_.dedup.brightnessBits);
+        std::lock_guard<std::mutex> lock(mutex_);
+        analyzeFrame = !lookupHash(hash, frame);
+    }
+    if (analyzeFrame && options_.sampling.enabled) {
+        cv::Mat thumbnail = samplingThumbnail(*coarse, options_.sampling.thumbnailWidth);
+        std::lock_guard<std::mutex> lock(mutex_);
+        analyzeFrame = shouldAnalyze(thumbnail, frame.changeScore);
+    }
+    if (analyzeFrame) {
+        auto start = std::chrono::steady_clock::now();
+        frame.scores = computeSabotageScores(gray, options_.analysis, withPyramid ? &pyramid : nullptr, &deviceGray);
+        if (options_.sampling.enabled) {
+            sharedAnalysisBudget().charge(
+                std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        }
+    }
+
+    bool withSceneChange = (options_.analysis.metrics & kMetricSceneChange) != 0;
+    if (!withSceneChange && !options_.alerts.enabled && !options_.sampling.enabled && !options_.dedup.enabled) {
+        return frame;
+    }
+
+    // Scene change is cheap next to the full analysis and keeps the background current, so it
+    // runs on every frame, sampled or not
+    cv::Mat mask = withSceneChange ? options_.analysis.resolveMask(gray) : cv::Mat();
+    bool withBackground = withSceneChange && options_.sceneChangeMode == SceneChangeMode::Background;
+    const cv::Mat* grid = withBackground && withPyramid ? pyramidLevelForScale(pyramid, options_.backgroundScale) : nullptr;
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!withSceneChange) {
+        // Scene change not selected
+    } else if (grid) {
+        frame.sceneChangeScore = background_.updateGrid(*grid, options_.backgroundAlpha, mask);
+    } else if (withBackground) {
+        frame.sceneChangeScore = background_.update(gray, options_.backgroundAlpha, options_.backgroundScale, mask);
+    } else {
+        bool comparable = !previousGray_.empty() && previousGray_.size() == gray.size();
+        frame.sceneChangeScore = comparable
+            ? calculateSceneChangeScore(gray, previousGray_, mask, options_.analysis.backend, deviceGray)
+            : 0.0;
+        previousGray_ = gray;
+    }
+
+    if (options_.sampling.enabled) {
+        if (analyzeFrame || frame.cached) {
+            lastScores_ = frame.scores;
+            hasScores_ = true;
+        } else {
+            frame.scores = lastScores_;
+            frame.reused = true;
+        }
+    }
+    if (options_.dedup.enabled && analyzeFrame) {
+        cacheScores(hash, frame.scores);
+    }
+
+    if (options_.alerts.enabled) {
+        // Unselected scores are NaN and so leave their alert untouched, as do reused ones. Cached
+        // scores belong to a matching frame and count like fresh ones.
+        const SabotageScores& scores = frame.scores;
+        double nan = std::numeric_limits<double>::quiet_NaN();
+        const double frameScores[kMetricCount] = {
+            frame.reused ? nan : scores.defocusScore, frame.reused ? nan : scores.blackoutScore,
+            frame.reused ? nan : scores.flashScore, frame.reused ? nan : scores.smearScore, frame.sceneChangeScore
+        };
+        frame.alerts = alerts_.update(frameScores);
+    }
+    return frame;
+}
+
+void SessionScorer::reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    previousGray_.release();
+    background_.reset();
+    alerts_.reset();
+    referenceThumbnail_.release();
+    hasScores_ = false;
+    interval_ = 1;
+    sinceAnalysis_ = 0;
+    cache_.clear();
+    identicalFrames_ = -1;
+}
+
+// Helper function to start a plain result with every score missing
+SabotageResult emptyResult(int status, const char* message = "") {
+    SabotageResult result;
+    double nan = std::numeric_limits<double>::quiet_NaN();
+    result.status = status;
+    result.metrics = 0;
+    result.shortCircuited = 0;
+    result.defocusScore = result.blackoutScore = result.flashScore = result.smearScore = nan;
+    result.sceneChangeScore = nan;
+    result.activeAlerts = result.changedAlerts = 0;
+    result.reused = result.cached = 0;
+    result.frozenScore = nan;
+    std::snprintf(result.message, sizeof(result.message), "%s", message);
+    return result;
+}
+
+// Helper function to run a scoring step, turning exceptions into an error result
+SabotageResult guardedResult(const std::function<SabotageResult()>& score) noexcept {
+    try {
+        return score();
+    }
+    catch (const std::exception& e) {
+        return emptyResult(kSabotageError, e.what());
+    }
+    catch (...) {
+        return emptyResult(kSabotageError, "Unknown error");
+    }
+}
+
+SabotageResult resultFromScores(const SabotageScores& scores) {
+    SabotageResult result = emptyResult(kSabotageOk);
+    result.metrics = scores.metrics;
+    result.shortCircuited = scores.shortCircuited ? 1 : 0;
+    result.defocusScore = scores.defocusScore;
+    result.blackoutScore = scores.blackoutScore;
+    result.flashScore = scores.flashScore;
+    result.smearScore = scores.smearScore;
+    return result;
+}
+
+SabotageResult scoreGrayFrame(const cv::Mat& gray, const AnalysisOptions& options) noexcept {
+    return guardedResult([&] {
+        if (gray.empty() || gray.type() != CV_8UC1) return emptyResult(kSabotageDecodeFailed, "Expected a CV_8UC1 frame");
+        return resultFromScores(computeSabotageScores(gray, options));
+    });
+}
+
+SabotageResult scoreRawFrame(const RawFrame& frame, const AnalysisOptions& options) noexcept {
+    return guardedResult([&] {
+        if (frame.data == nullptr || frame.width <= 0 || frame.height <= 0) {
+            return emptyResult(kSabotageDecodeFailed, "Empty raw frame");
+        }
+        return scoreGrayFrame(downscaleGray(readImageFromRaw(frame), options.analysisScale), options);
+    });
+}
+
+SabotageResult scoreEncodedFrame(const uint8_t* data, size_t length, const AnalysisOptions& options) noexcept {
+    return guardedResult([&] {
+        cv::Mat gray = readImageFromBuffer(data, length, grayscaleReadFlag(options.analysisScale));
+        if (gray.empty()) return emptyResult(kSabotageDecodeFailed, "Failed to read image");
+        return resultFromScores(computeSabotageScores(gray, options));
+    });
+}
+
+SabotageResult scoreSessionFrame(SessionScorer& session, const cv::Mat& gray) noexcept {
+    return guardedResult([&] {
+        if (gray.empty() || gray.type() != CV_8UC1) return emptyResult(kSabotageDecodeFailed, "Expected a CV_8UC1 frame");
+        SessionFrame frame = session.analyze(gray);
+        SabotageResult result = resultFromScores(frame.scores);
+        result.sceneChangeScore = frame.sceneChangeScore;
+        result.activeAlerts = frame.alerts.active;
+        result.changedAlerts = frame.alerts.changed;
+        result.reused = frame.reused ? 1 : 0;
+        result.cached = frame.cached ? 1 : 0;
+        result.frozenScore = frame.frozenScore;
+        return result;
+    });
+}
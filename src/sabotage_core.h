@@ -0,0 +1,743 @@
+// Image analysis core of the camera sabotage detector. Nothing here depends on Node-API,
+// so the same code backs the addon, the native benchmarks and other native callers.
+#ifndef SABOTAGE_CORE_H
+#define SABOTAGE_CORE_H
+
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Metrics that can be selected per call, as a bitmask
+enum Metric : uint32_t {
+    kMetricDefocus = 1 << 0,
+    kMetricBlackout = 1 << 1,
+    kMetricFlash = 1 << 2,
+    kMetricSmear = 1 << 3,
+    kMetricSceneChange = 1 << 4,
+    kAllMetrics = (1 << 5) - 1
+};
+
+// Number of metrics: index i of a per-metric array belongs to Metric bit (1 << i)
+const int kMetricCount = 5;
+
+struct TileGridScores;
+
+// Scores produced for a single frame by DetectSabotage
+struct SabotageScores {
+    uint32_t metrics = 0;         // Metric bits of the scores below that were computed
+    bool shortCircuited = false;  // The cascade skipped the structure stage
+    double defocusScore = 0.0;
+    double blackoutScore = 0.0;
+    double flashScore = 0.0;
+    double smearScore = 0.0;
+    std::shared_ptr<const TileGridScores> grid;  // Per-tile scores in grid mode
+};
+
+// Per-tile scores of a frame analysed in grid mode, tiles in row-major order
+struct TileGridScores {
+    int rows = 0;
+    int cols = 0;
+    std::vector<SabotageScores> tiles;
+    SabotageScores max;  // Highest score of each metric over all tiles
+};
+
+// Pixel layouts accepted for already decoded frames
+enum class PixelFormat { Gray8, NV12, I420, BGR };
+
+// Already decoded frame in caller-owned memory
+struct RawFrame {
+    const uint8_t* data = nullptr;
+    int width = 0;
+    int height = 0;
+    int stride = 0;
+    PixelFormat format = PixelFormat::Gray8;
+};
+
+struct TileAccumulator;
+
+// Intermediate images a thread reuses from frame to frame
+enum class ScratchImage {
+    Converted, Resized, Edges, MaskedEdges, Difference, Pyramid1, Pyramid2, Pyramid3, PyramidMask, Count
+};
+
+// Device-side (cv::UMat) counterparts used by the OpenCL backend
+enum class DeviceImage { Gray, Previous, Laplacian, GradientX, GradientY, Gradient, Edges, MaskedEdges, Difference, Count };
+
+// Per-thread pool of intermediate buffers. cv::Mat::create keeps the existing buffer when
+// size and type match, so once a thread has seen its largest frame, steady-state processing
+// does not allocate. Results such as decoded frames are handed to callers, so a buffer that
+// is still referenced elsewhere is never overwritten: the caller keeps it and the slot starts
+// a new one. Helpers using the arena hold a Scope, which lets release() run from any thread.
+class ScratchArena {
+public:
+    // Keeps the calling thread's arena locked while its buffers are written; scopes may nest
+    class Scope {
+    public:
+        Scope() : arena_(local()), lock_(arena_.mutex_) {}
+        ScratchArena& arena() { return arena_; }
+
+    private:
+        ScratchArena& arena_;
+        std::lock_guard<std::recursive_mutex> lock_;
+    };
+
+    cv::Mat& image(ScratchImage which);
+    cv::Mat& decodeTarget();
+    std::vector<TileAccumulator>& tiles() { return tiles_; }
+    cv::UMat& deviceImage(DeviceImage which) { return deviceImages_[static_cast<int>(which)]; }
+
+    // Device copy of an analysis mask, uploaded only when the mask changes (resolved masks
+    // are cached by AnalysisRegion, so this is once per region and frame size)
+    const cv::UMat& deviceMask(const cv::Mat& mask, double& maskPixels);
+
+    // Pooled bytes over all threads, and how many threads hold an arena
+    static size_t totalBytes(size_t* arenaCount = nullptr);
+    // Frees every thread's buffers (waiting for frames in progress); returns the bytes freed
+    static size_t releaseAll();
+
+private:
+    static const int kDecodeSlots = 2;  // Current and previous frame of a comparison
+
+    ScratchArena();
+    ~ScratchArena();
+    static ScratchArena& local();
+    size_t bytes();
+    size_t release();
+
+    std::recursive_mutex mutex_;
+    cv::Mat images_[static_cast<int>(ScratchImage::Count)];
+    cv::Mat decoded_[kDecodeSlots];
+    std::vector<TileAccumulator> tiles_;
+    cv::UMat deviceImages_[static_cast<int>(DeviceImage::Count)];
+    cv::Mat deviceMaskSource_;  // Host mask that deviceMask_ was uploaded from
+    cv::UMat deviceMask_;
+    double deviceMaskPixels_ = 0.0;
+};
+
+// Region of the frame that metrics are computed over, given in full-resolution pixel
+// coordinates. The include rectangles, exclude rectangles and mask are combined into a
+// single analysis-resolution mask, so the frame is scanned once however many ROIs there
+// are. The resolved mask is cached for the last frame size and shared by every frame.
+class AnalysisRegion {
+public:
+    std::vector<cv::Rect> include;  // Union of analysed rectangles; empty means the whole frame
+    std::vector<cv::Rect> exclude;  // Rectangles removed from the analysed area (e.g. overlays)
+    cv::Mat mask;                   // Optional CV_8U mask, 0 = ignored, 255 = analysed
+
+    // Thread-safe; returns a CV_8U mask of frameSize
+    cv::Mat resolve(cv::Size frameSize, int analysisScale) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!cached_.empty() && cachedSize_ == frameSize && cachedScale_ == analysisScale) {
+            return cached_;
+        }
+
+        cv::Rect frame(0, 0, frameSize.width, frameSize.height);
+        auto toAnalysis = [&](const cv::Rect& rect) {
+            int x0 = rect.x / analysisScale;
+            int y0 = rect.y / analysisScale;
+            int x1 = (rect.x + rect.width + analysisScale - 1) / analysisScale;
+            int y1 = (rect.y + rect.height + analysisScale - 1) / analysisScale;
+            return cv::Rect(x0, y0, x1 - x0, y1 - y0) & frame;
+        };
+
+        cv::Mat resolved(frameSize, CV_8UC1, cv::Scalar(include.empty() ? 255 : 0));
+        for (const cv::Rect& rect : include) {
+            cv::Rect area = toAnalysis(rect);
+            if (!area.empty()) resolved(area).setTo(cv::Scalar(255));
+        }
+        if (!mask.empty()) {
+            cv::Mat scaledMask;
+            cv::resize(mask, scaledMask, frameSize, 0, 0, cv::INTER_NEAREST);
+            cv::bitwise_and(resolved, scaledMask, resolved);
+        }
+        for (const cv::Rect& rect : exclude) {
+            cv::Rect area = toAnalysis(rect);
+            if (!area.empty()) resolved(area).setTo(cv::Scalar(0));
+        }
+        if (cv::countNonZero(resolved) == 0) {
+            throw std::runtime_error("Analysis region does not cover any pixels");
+        }
+
+        cached_ = resolved;
+        cachedSize_ = frameSize;
+        cachedScale_ = analysisScale;
+        return cached_;
+    }
+
+private:
+    mutable std::mutex mutex_;
+    mutable cv::Mat cached_;
+    mutable cv::Size cachedSize_;
+    mutable int cachedScale_ = 0;
+};
+
+// Where the histogram, Laplacian, edge and difference stages run
+enum class Backend {
+    Cpu,     // Fused native kernels
+    OpenCL   // cv::UMat through OpenCV's transparent API; falls back to Cpu without OpenCL
+};
+
+// Whether an OpenCL device is usable (checked once per process)
+bool openclAvailable();
+
+// How defocus is estimated
+enum class DefocusEstimator {
+    Laplacian,  // Variance of the Laplacian of the analysis frame
+    Pyramid     // Median of the Laplacian variance over a pyrDown chain, each level normalised
+                // to full resolution. A noisy finest level or a soft coarse one is outvoted.
+};
+
+// Most levels of the pyramid estimator, counting the analysis frame
+const int kMaxPyramidLevels = 4;
+
+// How smear scoring estimates edge density
+enum class EdgeEstimator {
+    Canny,    // Fraction of cv::Canny(50, 150) edge pixels
+    Gradient  // Calibrated count of strong Sobel gradients, fused with the Laplacian pass
+};
+
+// Options accepted by the async detection calls
+struct AnalysisOptions {
+    int analysisScale = 1;          // Frames are analysed at 1/analysisScale resolution (1, 2, 4 or 8)
+    uint32_t metrics = kAllMetrics; // Metric bits to compute; unselected stages are skipped
+    bool cascade = false;           // Skip defocus/smear when blackout or flash is conclusive
+    double cascadeThreshold = 95.0; // Blackout or flash score at which the cascade stops
+    std::shared_ptr<const AnalysisRegion> region;  // Restricts all metrics to part of the frame
+    int gridRows = 0;               // Grid mode tile rows; 0 disables grid mode
+    int gridCols = 0;
+    EdgeEstimator edgeEstimator = EdgeEstimator::Canny;
+    DefocusEstimator defocusEstimator = DefocusEstimator::Laplacian;
+    int pyramidLevels = 3;          // Levels of the pyramid estimator (2 to kMaxPyramidLevels)
+    bool timings = false;           // Report per-stage durations with the result
+    Backend backend = Backend::Cpu; // Grid mode and the pyramid estimator always run on the CPU
+
+    // Analysis-resolution mask for a frame, or an empty Mat for the whole frame
+    cv::Mat resolveMask(const cv::Mat& gray) const {
+        return region ? region->resolve(gray.size(), analysisScale) : cv::Mat();
+    }
+};
+
+// Per-frame statistics computed once and shared by all score functions
+struct FrameFeatures {
+    uint32_t histogram[256] = {};  // Pixel count per intensity
+    double totalPixels = 0.0;
+    double mean = 0.0;
+    double stddev = 0.0;
+    double laplacianVariance = 0.0;
+    double edgeDensity = 0.0;      // Fraction of pixels marked as edges
+
+    // Which of the stages above were run
+    bool hasIntensityStats = false;
+    bool hasLaplacian = false;
+    bool hasEdges = false;
+};
+
+// Gaussian pyramid of an analysis frame: level i is 2^i times smaller than level 0, the frame
+// itself. Levels are built on demand with cv::pyrDown into scratch buffers, so the stages of
+// one frame (defocus, smear edges, the session background) share a single chain.
+class FramePyramid {
+public:
+    void reset(const cv::Mat& gray) {
+        levels_.reserve(kMaxPyramidLevels);  // References to levels stay valid as more are built
+        levels_.assign(1, gray);
+    }
+    bool empty() const { return levels_.empty(); }
+
+    // Level i (0 to kMaxPyramidLevels - 1), building the missing levels
+    const cv::Mat& level(int i);
+
+private:
+    std::vector<cv::Mat> levels_;
+};
+
+// Processing stages that can be timed
+enum class Stage { Decode, Histogram, Laplacian, Edges, Grid, SceneChange, Total, Count };
+const int kStageCount = static_cast<int>(Stage::Count);
+
+// Name of a stage as reported to JS: "decode", "histogram", ...
+const char* stageName(Stage stage);
+
+// Stage durations of one call in milliseconds. A stage that runs more than once (the two
+// decodes of a scene-change call, for example) accumulates.
+struct StageTimings {
+    uint32_t recorded = 0;  // Bit (1 << stage) for every stage that ran
+    double milliseconds[kStageCount] = {};
+};
+
+// Timings of the call running on this thread, or null when the call did not ask for them
+extern thread_local StageTimings* tStageTimings;
+
+// Whether stage durations are also collected into the process-wide statistics
+extern std::atomic<bool> gStageStatsEnabled;
+
+void recordStage(Stage stage, std::chrono::steady_clock::duration elapsed);
+
+// Directs stage durations measured on the calling thread into timings while alive
+class TimingScope {
+public:
+    explicit TimingScope(StageTimings* timings) : previous_(tStageTimings) { tStageTimings = timings; }
+    ~TimingScope() { tStageTimings = previous_; }
+
+private:
+    StageTimings* previous_;
+};
+
+// Times a stage from construction to destruction. With per-call timings and statistics
+// both disabled it costs a thread-local and a relaxed atomic load, and reads no clock.
+class StageTimer {
+public:
+    explicit StageTimer(Stage stage)
+        : stage_(stage),
+          active_(tStageTimings != nullptr || gStageStatsEnabled.load(std::memory_order_relaxed)) {
+        if (active_) start_ = std::chrono::steady_clock::now();
+    }
+    ~StageTimer() {
+        if (active_) recordStage(stage_, std::chrono::steady_clock::now() - start_);
+    }
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+
+private:
+    Stage stage_;
+    bool active_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+// Process-wide duration distribution of one stage
+struct StageSummary {
+    uint64_t count = 0;
+    double totalMilliseconds = 0.0;
+    double p50Milliseconds = 0.0;  // Interpolated within the histogram bucket
+    double p99Milliseconds = 0.0;
+    std::vector<std::pair<double, uint64_t>> buckets;  // Cumulative count per upper bound in ms
+};
+
+StageSummary stageSummary(Stage stage);
+
+// Clears the process-wide statistics
+void resetStageStats();
+
+// Threads that already run one frame per thread (pool threads, and batch callers while they
+// take part in a batch) never split a frame further, so pool work cannot wait on itself
+extern thread_local bool tFrameLevelOnly;
+
+// Fixed-size pool of native threads used to spread batches of frames (or the row stripes
+// of one frame) across cores
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t threadCount) {
+        for (size_t i = 0; i < threadCount; i++) {
+            threads_.emplace_back([this] { workerLoop(); });
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_all();
+        for (std::thread& thread : threads_) {
+            thread.join();
+        }
+    }
+
+    size_t size() const { return threads_.size(); }
+
+    // Runs fn(i) for every i in [0, count) and blocks until all calls have returned.
+    // Items are claimed dynamically, and the calling thread takes part as well, so a
+    // slow frame does not hold up the rest of the batch.
+    void parallelFor(size_t count, const std::function<void(size_t)>& fn) {
+        if (count == 0) return;
+
+        std::atomic<size_t> next(0);
+        auto drain = [&] {
+            for (size_t i = next++; i < count; i = next++) {
+                fn(i);
+            }
+        };
+
+        size_t helpers = std::min(count - 1, threads_.size());
+        std::mutex doneMutex;
+        std::condition_variable doneCondition;
+        size_t pendingHelpers = helpers;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (size_t i = 0; i < helpers; i++) {
+                tasks_.emplace_back([&] {
+                    drain();
+                    std::lock_guard<std::mutex> doneLock(doneMutex);
+                    if (--pendingHelpers == 0) doneCondition.notify_one();
+                });
+            }
+        }
+        wake_.notify_all();
+
+        drain();
+        std::unique_lock<std::mutex> doneLock(doneMutex);
+        doneCondition.wait(doneLock, [&] { return pendingHelpers == 0; });
+    }
+
+private:
+    void workerLoop() {
+        tFrameLevelOnly = true;
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                wake_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+                if (stopping_ && tasks_.empty()) return;
+                task = std::move(tasks_.front());
+                tasks_.pop_front();
+            }
+            task();
+        }
+    }
+
+    std::vector<std::thread> threads_;
+    std::deque<std::function<void()>> tasks_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool stopping_ = false;
+};
+
+// Process-wide parallelism settings, changed through configure()
+struct ParallelismConfig {
+    std::mutex mutex;
+    std::shared_ptr<ThreadPool> pool;
+    size_t poolThreads = std::max(1u, std::thread::hardware_concurrency());
+    std::atomic<bool> intraFrame{false};
+};
+
+ParallelismConfig& parallelismConfig();
+
+// Pool shared by batches and intra-frame stripes, created on first use
+std::shared_ptr<ThreadPool> sharedThreadPool();
+
+// Replaces the shared pool; work already running keeps the pool it started on
+void resizeSharedThreadPool(size_t threadCount);
+
+// Marks the calling thread as frame-level for its lifetime, e.g. while it scores a batch
+class FrameLevelScope {
+public:
+    FrameLevelScope() : previous_(tFrameLevelOnly) { tFrameLevelOnly = true; }
+    ~FrameLevelScope() { tFrameLevelOnly = previous_; }
+
+private:
+    bool previous_;
+};
+
+// Decoding and scaling. imdecode takes the encoded bytes as a Mat with an int length, so larger
+// buffers are rejected with std::length_error instead of being truncated.
+const size_t kMaxEncodedImageBytes = static_cast<size_t>(std::numeric_limits<int>::max());
+cv::Mat readImageFromBuffer(const uint8_t* data, size_t length, int flags = cv::IMREAD_GRAYSCALE);
+cv::Mat readImageFromRaw(const RawFrame& frame);
+int grayscaleReadFlag(int analysisScale);
+cv::Mat downscaleGray(const cv::Mat& gray, int analysisScale, cv::Mat& reduced);
+cv::Mat downscaleGray(const cv::Mat& gray, int analysisScale);
+
+// Feature stages; the histogram stage feeds blackout and flash, the structure stage
+// (Laplacian and edges) feeds defocus and smear
+void computeHistogramStage(const cv::Mat& gray, const cv::Mat& mask, uint32_t metrics, FrameFeatures& features);
+void computeStructureStage(const cv::Mat& gray, const cv::Mat& mask, int analysisScale, uint32_t metrics,
+                           FrameFeatures& features, EdgeEstimator edgeEstimator = EdgeEstimator::Canny);
+void computePyramidStructureStage(FramePyramid& pyramid, const cv::Mat& mask, int analysisScale, uint32_t metrics,
+                                  int levels, FrameFeatures& features,
+                                  EdgeEstimator edgeEstimator = EdgeEstimator::Canny);
+FrameFeatures computeFrameFeatures(const cv::Mat& gray, int analysisScale = 1, uint32_t metrics = kAllMetrics,
+                                   const cv::Mat& mask = cv::Mat());
+
+// Scores, each in [0, 100]
+double calculateDefocusScore(const FrameFeatures& features);
+double calculateBlackoutScore(const FrameFeatures& features);
+double calculateFlashScore(const FrameFeatures& features);
+double calculateSmearScore(const FrameFeatures& features, double defocusScore);
+// With the OpenCL backend, deviceCurrent (if not empty) is a device copy of current that was
+// already uploaded, e.g. by computeSabotageScores, and is used instead of uploading it again
+double calculateSceneChangeScore(const cv::Mat& current, const cv::Mat& previous, const cv::Mat& mask = cv::Mat(),
+                                 Backend backend = Backend::Cpu, const cv::UMat& deviceCurrent = cv::UMat());
+
+// Scores a grayscale frame (already at analysis resolution) with the given options. With the
+// pyramid estimator, the levels it built are left in pyramid (if given) for later stages.
+// When the OpenCL stages ran, deviceGray (if given) shares the uploaded frame; it must be let
+// go before the next frame is scored on this thread, which reuses the buffer.
+SabotageScores computeSabotageScores(const cv::Mat& gray, const AnalysisOptions& options,
+                                     FramePyramid* pyramid = nullptr, cv::UMat* deviceGray = nullptr);
+
+// Options that compute only the smear score (and the defocus score it depends on)
+AnalysisOptions smearOnlyOptions(AnalysisOptions options);
+
+// Exponentially weighted background of a camera, kept on a downscaled grid so each
+// update costs O(pixels / backgroundScale^2)
+class BackgroundModel {
+public:
+    // Compares the frame with the background, then blends the frame into it.
+    // The first frame (or a frame of a different size) seeds the model and scores 0.
+    // An analysis mask, if given, restricts the comparison to the masked part of the grid.
+    double update(const cv::Mat& gray, double alpha, int scale, const cv::Mat& mask = cv::Mat()) {
+        StageTimer timer(Stage::SceneChange);
+        return compareAndBlend(downscaleGray(gray, scale, grid_), alpha, mask);
+    }
+
+    // Same as update for a frame that was already reduced to the grid
+    double updateGrid(const cv::Mat& grid, double alpha, const cv::Mat& mask = cv::Mat()) {
+        StageTimer timer(Stage::SceneChange);
+        return compareAndBlend(grid, alpha, mask);
+    }
+
+    void reset() {
+        background_.release();
+        grid_.release();
+        current_.release();
+        diff_.release();
+        gridMask_.release();
+    }
+
+private:
+    double compareAndBlend(const cv::Mat& grid, double alpha, const cv::Mat& mask) {
+        if (background_.empty() || background_.size() != grid.size()) {
+            grid.convertTo(background_, CV_32F);
+            return 0.0;
+        }
+
+        grid.convertTo(current_, CV_32F);
+        cv::absdiff(current_, background_, diff_);
+        double avgDiff = 0.0;
+        if (mask.empty()) {
+            avgDiff = cv::mean(diff_)[0];
+        } else {
+            cv::resize(mask, gridMask_, grid.size(), 0, 0, cv::INTER_NEAREST);
+            avgDiff = cv::countNonZero(gridMask_) > 0 ? cv::mean(diff_, gridMask_)[0] : 0.0;
+        }
+        cv::accumulateWeighted(grid, background_, alpha);
+
+        // Same scale as calculateSceneChangeScore
+        return std::min(100.0, std::max(0.0, (avgDiff / 50.0) * 100.0));
+    }
+
+    cv::Mat background_;  // CV_32F running average
+    // Per-session scratch buffers, reused from frame to frame
+    cv::Mat grid_;
+    cv::Mat current_;
+    cv::Mat diff_;
+    cv::Mat gridMask_;
+};
+
+// How a session measures scene change
+enum class SceneChangeMode { Background, Previous };
+
+// Temporal filtering of a session's scores. Each score is smoothed with an EMA, and an
+// alert is raised when at least `required` of the last `window` smoothed scores reach its
+// threshold, and cleared when as many fall below threshold - hysteresis.
+struct AlertOptions {
+    bool enabled = false;
+    double alpha = 0.3;        // Weight of each new score in the EMA
+    int window = 5;            // M of N-of-M (1-32 frames)
+    int required = 3;          // N of N-of-M
+    double hysteresis = 10.0;  // Gap between the raise and clear thresholds
+    double thresholds[kMetricCount] = {50.0, 50.0, 50.0, 50.0, 50.0};
+};
+
+// Filtered state after one frame
+struct AlertState {
+    uint32_t active = 0;   // Metric bits whose alert is raised
+    uint32_t changed = 0;  // Metric bits raised or cleared by this frame
+    double smoothed[kMetricCount] = {};  // EMA of each score; NaN until the score was computed
+};
+
+// EMA plus N-of-M hysteresis over the scores of consecutive frames
+class AlertFilter {
+public:
+    explicit AlertFilter(const AlertOptions& options) : options_(options) { reset(); }
+
+    // Folds in one frame's scores (index order as kMetricCount; NaN leaves a metric unchanged)
+    AlertState update(const double scores[kMetricCount]);
+    void reset();
+
+private:
+    struct Track {
+        double ema;
+        uint32_t above;  // Bit per recent frame: smoothed score reached the threshold
+        uint32_t below;  // Bit per recent frame: smoothed score fell below the clear threshold
+    };
+
+    AlertOptions options_;
+    Track tracks_[kMetricCount];
+    uint32_t active_ = 0;
+};
+
+// Adaptive sampling of a session. A thumbnail of every frame is compared with the thumbnail
+// of the last analysed frame; while the difference stays below changeThreshold the full
+// analysis only runs every interval frames, and other frames reuse the last scores. The
+// interval doubles after each stable analysis up to maxInterval and drops back to 1 on the
+// first frame that changed.
+struct SamplingOptions {
+    bool enabled = false;
+    double changeThreshold = 5.0;  // Thumbnail change score (0-100, scene-change scale) that counts as change
+    int maxInterval = 16;          // Longest stride between analyses of a stable camera
+    int thumbnailWidth = 32;       // Width of the comparison thumbnail in pixels
+};
+
+// Process-wide budget of analysis time shared by all sampling sessions: a token bucket
+// refilled with millisecondsPerSecond every second and holding at most one second of it.
+// Stable frames are only analysed while the bucket holds time; changed frames always run.
+// Both are charged with their measured analysis time.
+class AnalysisBudget {
+public:
+    // 0 disables the budget
+    void configure(double millisecondsPerSecond);
+    double millisecondsPerSecond() const;
+
+    bool available();
+    void charge(double milliseconds);
+
+private:
+    void refill(std::chrono::steady_clock::time_point now);
+
+    mutable std::mutex mutex_;
+    double rate_ = 0.0;
+    double tokens_ = 0.0;
+    std::chrono::steady_clock::time_point last_;
+};
+
+AnalysisBudget& sharedAnalysisBudget();
+
+// Frame deduplication of a session. Each frame gets a 64-bit difference hash (dHash) of its
+// analysis image; a frame within maxDistance bits of a recently analysed one reuses that
+// frame's scores. A hash that stays exactly the same for frozenFrames frames marks the feed
+// as frozen (a stalled or looped encoder, or a still image in front of the lens).
+struct DedupOptions {
+    bool enabled = false;
+    int maxDistance = 2;     // Hamming distance (0-64) that still counts as the same frame
+    int cacheSize = 16;      // Recently analysed hashes kept with their scores
+    int frozenFrames = 50;   // Consecutive identical hashes that mark the feed frozen
+    int brightnessBits = 4;  // Leading bits (0-8) of the mean brightness that must match as well
+};
+
+// Cache key of a frame. The dHash only sees gradients, so uniform frames of any brightness
+// share it; the quantised mean keeps a dark frame from answering for a bright one.
+struct FrameHash {
+    uint64_t bits = 0;   // One bit per horizontal neighbour pair of the 9x8 area-averaged thumbnail
+    int brightness = 0;  // Mean of the thumbnail, shifted down to brightnessBits bits
+};
+
+FrameHash frameHash(const cv::Mat& gray, int brightnessBits = 4);
+int hashDistance(uint64_t a, uint64_t b);
+
+// Options of a per-camera session
+struct SessionOptions {
+    AnalysisOptions analysis;
+    SceneChangeMode sceneChangeMode = SceneChangeMode::Background;
+    double backgroundAlpha = 0.1;  // Weight of each new frame in the running background
+    int backgroundScale = 4;       // Extra downscale of the analysis frame for the background grid
+    AlertOptions alerts;
+    SamplingOptions sampling;
+    DedupOptions dedup;
+};
+
+// Everything a session produces for one frame
+struct SessionFrame {
+    SabotageScores scores;
+    double sceneChangeScore = std::numeric_limits<double>::quiet_NaN();
+    AlertState alerts;         // Only filled with options.alerts.enabled
+    bool reused = false;       // Sampling skipped the analysis; scores are those of the last analysed frame
+    double changeScore = std::numeric_limits<double>::quiet_NaN();  // Sampling: thumbnail change against
+                                                                    // the last analysed frame
+    bool cached = false;       // Dedup: scores come from the cache entry of a matching hash
+    double frozenScore = std::numeric_limits<double>::quiet_NaN();  // Dedup: 0-100, 100 once the hash
+                                                                    // was constant for frozenFrames frames
+};
+
+// Per-camera analysis state. Scene change is measured against a running background (or the
+// last frame), so nothing but the new frame is decoded or passed in per call.
+class SessionScorer {
+public:
+    explicit SessionScorer(SessionOptions options) : options_(std::move(options)), alerts_(options_.alerts) {}
+
+    const SessionOptions& options() const { return options_; }
+    bool keepsPreviousFrame() const { return options_.sceneChangeMode == SceneChangeMode::Previous; }
+
+    // Scores a decoded frame and folds it into the scene-change, alert and sampling state. In
+    // 'previous' mode the frame is kept, so it must not be caller memory that is reused afterwards.
+    // Safe to call from several threads; concurrent calls are applied in completion order.
+    SessionFrame analyze(const cv::Mat& gray);
+
+    // Forgets the background, previous frame, alert, sampling and dedup state
+    void reset();
+
+private:
+    bool shouldAnalyze(const cv::Mat& thumbnail, double& changeScore);
+    bool lookupHash(const FrameHash& hash, SessionFrame& frame);
+    void cacheScores(const FrameHash& hash, const SabotageScores& scores);
+
+    struct CacheEntry {
+        FrameHash hash;
+        uint64_t lastUsed;
+        SabotageScores scores;
+    };
+
+    SessionOptions options_;
+    std::mutex mutex_;
+    cv::Mat previousGray_;
+    BackgroundModel background_;
+    AlertFilter alerts_;
+
+    // Sampling state
+    cv::Mat referenceThumbnail_;  // Thumbnail of the last analysed frame
+    SabotageScores lastScores_;
+    bool hasScores_ = false;
+    int interval_ = 1;
+    int sinceAnalysis_ = 0;
+
+    // Dedup state
+    std::vector<CacheEntry> cache_;
+    uint64_t cacheClock_ = 0;
+    FrameHash lastHash_;
+    int identicalFrames_ = -1;  // Frames since the hash last changed; -1 before the first frame
+};
+
+// Outcome of the plain entry points below
+enum SabotageStatus {
+    kSabotageOk = 0,
+    kSabotageDecodeFailed = 1,  // Empty input or undecodable image
+    kSabotageError = 2          // OpenCV or allocation failure, described in message
+};
+
+// Plain result for native callers; every field is written. Scores that were not computed
+// are NaN.
+struct SabotageResult {
+    int status;
+    uint32_t metrics;      // Metric bits of the scores below that were computed
+    int shortCircuited;    // The cascade skipped the structure stage
+    double defocusScore;
+    double blackoutScore;
+    double flashScore;
+    double smearScore;
+    double sceneChangeScore;
+    uint32_t activeAlerts;   // Session alerts: Metric bits raised after this frame
+    uint32_t changedAlerts;  // Session alerts: Metric bits raised or cleared by this frame
+    int reused;              // Session sampling: scores were reused from the last analysed frame
+    int cached;              // Session dedup: scores came from the cache
+    double frozenScore;      // Session dedup: frozen feed score, NaN without dedup
+    char message[128];     // Error description, empty on success
+};
+
+// Entry points for native callers (ingest services, benchmarks). They never throw: failures
+// are reported through SabotageResult::status. Grid scores are not part of the plain result.
+SabotageResult scoreGrayFrame(const cv::Mat& gray, const AnalysisOptions& options) noexcept;
+SabotageResult scoreRawFrame(const RawFrame& frame, const AnalysisOptions& options) noexcept;
+SabotageResult scoreEncodedFrame(const uint8_t* data, size_t length, const AnalysisOptions& options) noexcept;
+SabotageResult scoreSessionFrame(SessionScorer& session, const cv::Mat& gray) noexcept;
+
+#endif  // SABOTAGE_CORE_H
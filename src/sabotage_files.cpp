@@ -0,0 +1,371 @@
+#include "sabotage_files.h"
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <stdexcept>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+        close();
+        data_ = other.data_;
+        size_ = other.size_;
+        other.data_ = nullptr;
+        other.size_ = 0;
+#ifdef _WIN32
+        mapping_ = other.mapping_;
+        other.mapping_ = nullptr;
+#endif
+    }
+    return *this;
+}
+
+#ifdef _WIN32
+std::string MappedFile::open(const std::string& path) {
+    close();
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return "Failed to open " + path;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) {
+        CloseHandle(file);
+        return "Failed to stat " + path;
+    }
+    if (static_cast<unsigned long long>(size.QuadPart) > kMaxEncodedImageBytes) {
+        CloseHandle(file);
+        return path + " is too large to decode (2 GiB or more)";
+    }
+    if (size.QuadPart > 0) {
+        mapping_ = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        void* view = mapping_ ? MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0) : nullptr;
+        if (!view) {
+            CloseHandle(file);
+            close();
+            return "Failed to map " + path;
+        }
+        data_ = static_cast<const uint8_t*>(view);
+        size_ = static_cast<size_t>(size.QuadPart);
+    }
+    CloseHandle(file);
+    return "";
+}
+
+void MappedFile::close() {
+    if (data_) UnmapViewOfFile(data_);
+    if (mapping_) CloseHandle(mapping_);
+    data_ = nullptr;
+    size_ = 0;
+    mapping_ = nullptr;
+}
+#else
+std::string MappedFile::open(const std::string& path) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return "Failed to open " + path;
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        ::close(fd);
+        return "Failed to stat " + path;
+    }
+    if (static_cast<unsigned long long>(info.st_size) > kMaxEncodedImageBytes) {
+        ::close(fd);
+        return path + " is too large to decode (2 GiB or more)";
+    }
+    if (info.st_size > 0) {
+        size_t size = static_cast<size_t>(info.st_size);
+        void* address = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (address == MAP_FAILED) {
+            ::close(fd);
+            return "Failed to map " + path;
+        }
+        // Starts asynchronous readahead, so the pages are in memory by the time a decoder gets here
+        madvise(address, size, MADV_WILLNEED);
+        data_ = static_cast<const uint8_t*>(address);
+        size_ = size;
+    }
+    ::close(fd);
+    return "";
+}
+
+void MappedFile::close() {
+    if (data_) munmap(const_cast<uint8_t*>(data_), size_);
+    data_ = nullptr;
+    size_ = 0;
+}
+#endif
+
+// Bounded queue between the prefetch thread and the decoders
+class PrefetchQueue {
+public:
+    struct Item {
+        size_t index;
+        MappedFile file;
+        std::string error;
+    };
+
+    explicit PrefetchQueue(size_t capacity) : capacity_(std::max<size_t>(1, capacity)) {}
+
+    // Waits for room; returns false once the queue was closed
+    bool push(Item&& item) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        notFull_.wait(lock, [this] { return items_.size() < capacity_ || closed_; });
+        if (closed_) return false;
+        items_.push_back(std::move(item));
+        notEmpty_.notify_one();
+        return true;
+    }
+
+    // Waits for an item; returns false once the queue is closed and drained
+    bool pop(Item& item) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        notEmpty_.wait(lock, [this] { return !items_.empty() || finished_ || closed_; });
+        if (items_.empty() || closed_) return false;
+        item = std::move(items_.front());
+        items_.pop_front();
+        notFull_.notify_one();
+        return true;
+    }
+
+    // The producer has pushed every item
+    void finish() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        finished_ = true;
+        notEmpty_.notify_all();
+    }
+
+    // Drops pending items and releases both sides
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+        items_.clear();
+        notEmpty_.notify_all();
+        notFull_.notify_all();
+    }
+
+private:
+    size_t capacity_;
+    std::mutex mutex_;
+    std::condition_variable notEmpty_;
+    std::condition_variable notFull_;
+    std::deque<Item> items_;
+    bool finished_ = false;
+    bool closed_ = false;
+};
+
+// Job threads other than the caller. On the way out, normal or not, the queue is closed so a
+// blocked prefetcher or decoder returns, and every thread is joined before the job's state
+// goes out of scope.
+class JobThreads {
+public:
+    explicit JobThreads(PrefetchQueue& queue) : queue_(queue) {}
+    ~JobThreads() { join(); }
+
+    JobThreads(const JobThreads&) = delete;
+    JobThreads& operator=(const JobThreads&) = delete;
+
+    void start(const std::function<void()>& body) { threads_.emplace_back(body); }
+
+    void join() {
+        queue_.close();
+        for (std::thread& thread : threads_) {
+            if (thread.joinable()) thread.join();
+        }
+    }
+
+private:
+    PrefetchQueue& queue_;
+    std::vector<std::thread> threads_;
+};
+
+FileJobSummary processFiles(const std::vector<std::string>& paths, const FileJobOptions& options,
+                            const std::function<void(FileResult&&)>& sink, const std::atomic<bool>* cancel) {
+    auto start = std::chrono::steady_clock::now();
+    const AnalysisOptions& analysis = options.analysis;
+    PrefetchQueue queue(options.prefetch);
+    std::atomic<size_t> processed(0), failed(0);
+
+    // A failure outside a single file (the sink, or the job's own bookkeeping) stops the job;
+    // the first message is reported once every thread has finished
+    std::atomic<bool> stopped(false);
+    std::mutex failureMutex;
+    std::string failure;
+    auto stop = [&](const char* message) {
+        std::lock_guard<std::mutex> lock(failureMutex);
+        if (failure.empty()) failure = message;
+        stopped = true;
+        queue.close();  // Wakes threads waiting on the queue
+    };
+    auto cancelled = [&] { return stopped.load() || (cancel && cancel->load()); };
+    // Runs body on a job thread, turning anything it throws into a stop
+    auto guarded = [&](const std::function<void()>& body) {
+        return [&, body] {
+            try {
+                body();
+            }
+            catch (const std::exception& e) {
+                stop(e.what());
+            }
+            catch (...) {
+                stop("Unknown error in file job");
+            }
+        };
+    };
+
+    auto prefetch = [&] {
+        for (size_t i = 0; i < paths.size() && !cancelled(); i++) {
+            PrefetchQueue::Item item;
+            item.index = i;
+            item.error = item.file.open(paths[i]);
+            if (!queue.push(std::move(item))) break;
+        }
+        queue.finish();
+    };
+
+    // The decoders are owned by the job rather than taken from the shared pool: they block on
+    // the queue and in the sink, which would hold up batches and intra-frame stripes queued
+    // behind them. Each runs whole files, so stripes are not split further.
+    auto decodeFiles = [&] {
+        FrameLevelScope frameLevel;
+        PrefetchQueue::Item item;
+        while (!cancelled() && queue.pop(item)) {
+            FileResult result;
+            result.index = item.index;
+            result.error = std::move(item.error);
+            if (result.error.empty()) {
+                TimingScope timing(analysis.timings ? &result.timings : nullptr);
+                StageTimer total(Stage::Total);
+                try {
+                    cv::Mat gray;
+                    {
+                        StageTimer decode(Stage::Decode);
+                        gray = readImageFromBuffer(item.file.data(), item.file.size(),
+                                                   grayscaleReadFlag(analysis.analysisScale));
+                    }
+                    item.file.close();  // The decoded image no longer needs the mapping
+                    if (gray.empty()) {
+                        result.error = "Failed to read image";
+                    } else {
+                        result.scores = computeSabotageScores(gray, analysis);
+                    }
+                }
+                catch (const std::exception& e) {
+                    result.error = e.what();
+                }
+            }
+            item.file.close();
+            (result.error.empty() ? processed : failed)++;
+            sink(std::move(result));
+        }
+    };
+
+    size_t decoderCount = options.decoders;
+    if (decoderCount == 0) {
+        ParallelismConfig& config = parallelismConfig();
+        std::lock_guard<std::mutex> lock(config.mutex);
+        decoderCount = config.poolThreads;
+    }
+    {
+        JobThreads threads(queue);
+        threads.start(guarded(prefetch));
+        // This thread is one of the decoders; if the OS refuses more threads, the job runs on fewer
+        for (size_t i = 1; i < decoderCount; i++) {
+            try {
+                threads.start(guarded(decodeFiles));
+            }
+            catch (const std::exception&) {
+                break;
+            }
+        }
+        // Once this decoder returns the queue is drained (or the job was stopped), so closing
+        // it while joining the others drops no file that was still due
+        guarded(decodeFiles)();
+    }
+    if (!failure.empty()) {
+        throw std::runtime_error(failure);
+    }
+
+    FileJobSummary summary;
+    summary.processed = processed;
+    summary.failed = failed;
+    summary.cancelled = cancel && cancel->load();
+    summary.elapsedMs =
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return summary;
+}
+
+// Helper function to append a JSON string literal
+void appendJsonString(std::string& out, const std::string& value) {
+    out += '"';
+    for (char c : value) {
+        unsigned char byte = static_cast<unsigned char>(c);
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (byte < 0x20) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", byte);
+            out += escaped;
+        } else {
+            out += c;
+        }
+    }
+    out += '"';
+}
+
+// Helper function to append a "name":number member; NaN becomes null
+void appendJsonNumber(std::string& out, const char* name, double value) {
+    char buffer[64];
+    if (std::isnan(value)) {
+        std::snprintf(buffer, sizeof(buffer), ",\"%s\":null", name);
+    } else {
+        std::snprintf(buffer, sizeof(buffer), ",\"%s\":%.6g", name, value);
+    }
+    out += buffer;
+}
+
+std::string NdjsonWriter::open(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    file_ = std::fopen(path.c_str(), "wb");
+    failed_ = false;
+    return file_ ? "" : "Failed to open " + path + " for writing";
+}
+
+void NdjsonWriter::write(const FileResult& result, const std::string& path) {
+    std::string line = "{\"index\":" + std::to_string(result.index) + ",\"path\":";
+    appendJsonString(line, path);
+    if (!result.error.empty()) {
+        line += ",\"error\":";
+        appendJsonString(line, result.error);
+    } else {
+        const SabotageScores& scores = result.scores;
+        if (scores.metrics & kMetricDefocus) appendJsonNumber(line, "defocusScore", scores.defocusScore);
+        if (scores.metrics & kMetricBlackout) appendJsonNumber(line, "blackoutScore", scores.blackoutScore);
+        if (scores.metrics & kMetricFlash) appendJsonNumber(line, "flashScore", scores.flashScore);
+        if (scores.metrics & kMetricSmear) appendJsonNumber(line, "smearScore", scores.smearScore);
+        if (scores.shortCircuited) line += ",\"shortCircuited\":true";
+    }
+    line += "}\n";
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!file_) return;
+    if (std::fwrite(line.data(), 1, line.size(), file_) != line.size()) failed_ = true;
+}
+
+bool NdjsonWriter::close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (file_ && std::fclose(file_) != 0) failed_ = true;
+    file_ = nullptr;
+    return !failed_;
+}
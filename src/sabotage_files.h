@@ -0,0 +1,92 @@
+// Offline reprocessing of archived image files: files are memory-mapped ahead of the decoders
+// by a prefetch thread, decoded at reduced scale and scored by decoder threads of the job, so
+// reading and decoding overlap instead of running one file after another.
+#ifndef SABOTAGE_FILES_H
+#define SABOTAGE_FILES_H
+
+#include "sabotage_core.h"
+#include <cstdio>
+#include <string>
+
+// Read-only memory mapping of a whole file. Empty files map to no data.
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile() { close(); }
+
+    MappedFile(MappedFile&& other) noexcept { *this = std::move(other); }
+    MappedFile& operator=(MappedFile&& other) noexcept;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Maps the file and asks the OS to start reading it in. Files above kMaxEncodedImageBytes
+    // are refused. Returns an error message, or an empty string on success.
+    std::string open(const std::string& path);
+    void close();
+
+    const uint8_t* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+#ifdef _WIN32
+    void* mapping_ = nullptr;
+#endif
+};
+
+// Options of a file job
+struct FileJobOptions {
+    AnalysisOptions analysis;
+    size_t prefetch = 32;  // Mapped files waiting for a decoder
+    size_t decoders = 0;   // Decoder threads, the calling one included; 0 for the pool size
+};
+
+// Outcome of one file
+struct FileResult {
+    size_t index = 0;       // Position of the file in the job's path list
+    SabotageScores scores;
+    StageTimings timings;   // Only filled with options.analysis.timings
+    std::string error;      // Why the file failed, empty on success
+};
+
+struct FileJobSummary {
+    size_t processed = 0;  // Files scored
+    size_t failed = 0;     // Files that could not be read, decoded or scored
+    bool cancelled = false;  // Stopped by cancel before every file was scored
+    double elapsedMs = 0.0;
+};
+
+// Scores every file of paths. The sink is called once per file from the decoder threads, in
+// completion order, and may block to hold the job back. Setting cancel (if given) stops the
+// job after the files in progress. Files that fail are reported through the sink; if the sink
+// itself throws, the job stops and, once its threads have finished, rethrows the message as
+// std::runtime_error.
+FileJobSummary processFiles(const std::vector<std::string>& paths, const FileJobOptions& options,
+                            const std::function<void(FileResult&&)>& sink,
+                            const std::atomic<bool>* cancel = nullptr);
+
+// Writes results as newline-delimited JSON, one object per file: {index, path, <scores>} or
+// {index, path, error}. Safe to call from several threads.
+class NdjsonWriter {
+public:
+    NdjsonWriter() = default;
+    ~NdjsonWriter() { close(); }
+
+    NdjsonWriter(const NdjsonWriter&) = delete;
+    NdjsonWriter& operator=(const NdjsonWriter&) = delete;
+
+    // Returns an error message, or an empty string on success
+    std::string open(const std::string& path);
+    void write(const FileResult& result, const std::string& path);
+
+    // Returns false if any write failed
+    bool close();
+
+private:
+    std::mutex mutex_;
+    std::FILE* file_ = nullptr;
+    bool failed_ = false;
+};
+
+#endif  // SABOTAGE_FILES_H
@@ -0,0 +1,94 @@
+#include "sabotage_stream.h"
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+void StreamReader::start() {
+    thread_ = std::thread([this] { run(); });
+}
+
+void StreamReader::stop() {
+    stopping_ = true;
+    if (thread_.joinable() && thread_.get_id() != std::this_thread::get_id()) {
+        thread_.join();
+    }
+}
+
+// Helper function to convert a retrieved frame to grayscale at the analysis scale
+cv::Mat streamFrameToGray(const cv::Mat& frame, int analysisScale, cv::Mat& converted, cv::Mat& reduced) {
+    const cv::Mat* gray = &frame;
+    if (frame.channels() == 3) {
+        cv::cvtColor(frame, converted, cv::COLOR_BGR2GRAY);
+        gray = &converted;
+    } else if (frame.channels() == 4) {
+        cv::cvtColor(frame, converted, cv::COLOR_BGRA2GRAY);
+        gray = &converted;
+    }
+    return downscaleGray(*gray, analysisScale, reduced);
+}
+
+void StreamReader::run() {
+    using Clock = std::chrono::steady_clock;
+    StreamEvent end;
+    end.kind = StreamEvent::Kind::End;
+    try {
+        cv::VideoCapture capture(url_);
+        if (!capture.isOpened()) {
+            end.error = "Failed to open " + url_;
+            sink_(std::move(end));
+            return;
+        }
+
+        const double intervalMs = 1000.0 / options_.fps;
+        const AnalysisOptions& analysis = options_.session.analysis;
+        Clock::time_point opened = Clock::now();
+        double nextDueMs = 0.0;
+        cv::Mat frame, converted, reduced;
+        uint64_t index = 0;
+        for (; !stopping_; index++) {
+            if (!capture.grab()) break;  // End of file or lost connection
+
+            // Live sources often report no position, so fall back to the time since opening
+            double timestampMs = capture.get(cv::CAP_PROP_POS_MSEC);
+            if (!(timestampMs > 0.0)) {
+                timestampMs = std::chrono::duration<double, std::milli>(Clock::now() - opened).count();
+            }
+            if (timestampMs < nextDueMs) continue;
+            // Keep a steady rate, but do not try to catch up after a stall
+            nextDueMs = std::max(nextDueMs + intervalMs, timestampMs + intervalMs / 2);
+
+            StreamEvent event;
+            event.frameIndex = index;
+            event.timestampMs = timestampMs;
+            try {
+                TimingScope timing(analysis.timings ? &event.timings : nullptr);
+                StageTimer total(Stage::Total);
+                cv::Mat gray;
+                {
+                    StageTimer decode(Stage::Decode);
+                    if (!capture.retrieve(frame) || frame.empty()) {
+                        throw std::runtime_error("Failed to retrieve frame");
+                    }
+                    // A session in 'previous' mode keeps the frame, so it must get a buffer of its own
+                    if (session_.keepsPreviousFrame()) {
+                        converted.release();
+                        reduced.release();
+                    }
+                    gray = streamFrameToGray(frame, analysis.analysisScale, converted, reduced);
+                    if (session_.keepsPreviousFrame() && gray.data == frame.data) gray = gray.clone();
+                }
+                event.frame = session_.analyze(gray);
+            }
+            catch (const std::exception& e) {
+                event.kind = StreamEvent::Kind::Error;
+                event.error = e.what();
+            }
+            sink_(std::move(event));
+        }
+        end.frameIndex = index;
+    }
+    catch (const std::exception& e) {
+        end.error = e.what();
+    }
+    sink_(std::move(end));
+}
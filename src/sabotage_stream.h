@@ -0,0 +1,65 @@
+// Native frame source: pulls a video file or RTSP stream through opencv_videoio and scores
+// frames at a fixed analysis rate. Only built when binding.gyp enables videoio
+// (SABOTAGE_WITH_VIDEOIO=true), since that module is not part of every OpenCV install.
+#ifndef SABOTAGE_STREAM_H
+#define SABOTAGE_STREAM_H
+
+#include "sabotage_core.h"
+#include <opencv2/videoio.hpp>
+#include <string>
+
+// Options of a stream, on top of the session options used to score its frames
+struct StreamOptions {
+    SessionOptions session;
+    double fps = 1.0;  // Frames analysed per second of stream time
+};
+
+// An analysed frame, a frame that failed, or the end of the stream
+struct StreamEvent {
+    enum class Kind { Result, Error, End };
+
+    Kind kind = Kind::Result;
+    uint64_t frameIndex = 0;  // Index of the frame in the stream, counting skipped frames.
+                              // For End, the number of frames read.
+    double timestampMs = 0.0; // Stream position, or time since opening for live sources
+    SessionFrame frame;       // Scores, scene change, alerts and sampling state of a Result
+    StageTimings timings;     // Only filled with options.session.analysis.timings
+    std::string error;        // Why the frame failed, or why the stream stopped (empty at its end)
+};
+
+// Reads a stream on a dedicated thread. Frames between two analysis points are grabbed but
+// not retrieved, so they are never decoded into images. Sampled frames are converted to
+// grayscale, scored through a SessionScorer and passed to the sink on the reader thread.
+// A frame that fails yields an Error event and reading goes on; the last event is End.
+class StreamReader {
+public:
+    using Sink = std::function<void(StreamEvent&&)>;
+
+    StreamReader(std::string url, StreamOptions options, Sink sink)
+        : url_(std::move(url)), options_(std::move(options)), sink_(std::move(sink)),
+          session_(options_.session) {}
+    ~StreamReader() { stop(); }
+
+    StreamReader(const StreamReader&) = delete;
+    StreamReader& operator=(const StreamReader&) = delete;
+
+    void start();
+
+    // Asks the thread to finish after the current grab and waits for it
+    void stop();
+
+    // Asks the thread to finish without waiting; End follows
+    void requestStop() { stopping_ = true; }
+
+private:
+    void run();
+
+    std::string url_;
+    StreamOptions options_;
+    Sink sink_;
+    SessionScorer session_;
+    std::atomic<bool> stopping_{false};
+    std::thread thread_;
+};
+
+#endif  // SABOTAGE_STREAM_H
@@ -0,0 +1,35 @@
+// Runs the native tests (`npm test`): rebuilds the addon together with the sabotage_core_test
+// binary and runs it, passing the remaining arguments through.
+//
+//   npm test -- [--filter=SUBSTRING] [--no_build]
+const { spawnSync } = require('child_process');
+const path = require('path');
+
+const root = path.join(__dirname, '..');
+
+function run(command, commandArgs, env) {
+  const result = spawnSync(command, commandArgs, { cwd: root, stdio: 'inherit', env: { ...process.env, ...env } });
+  if (result.error) throw result.error;
+  if (result.status !== 0) {
+    throw new Error(`${path.basename(command)} exited with status ${result.status}`);
+  }
+}
+
+function main() {
+  const args = process.argv.slice(2);
+  const build = !args.includes('--no_build');
+  if (build) {
+    run(process.execPath, [require.resolve('node-gyp/bin/node-gyp.js'), 'rebuild'], { SABOTAGE_BUILD_TESTS: 'true' });
+  }
+
+  const binary = path.join(root, 'build', 'Release',
+                           process.platform === 'win32' ? 'sabotage_core_test.exe' : 'sabotage_core_test');
+  run(binary, args.filter((arg) => arg !== '--no_build'));
+}
+
+try {
+  main();
+} catch (error) {
+  console.error(error.message);
+  process.exitCode = 1;
+}
@@ -0,0 +1,313 @@
+// Equivalence checks of the hand-written feature kernels against the OpenCV operations they
+// replace: the fused Laplacian (and Sobel gradient) pass against cv::Laplacian / cv::Sobel with
+// cv::meanStdDev, the sub-histogram accumulator against cv::calcHist, and grid mode's per-tile
+// sums against the frame-level path. Frames are random at sizes chosen to hit the vector
+// tails, the reflected borders, 1-3 pixel frames and rows longer than the lane flush interval.
+// The runner is self-contained, like the benchmarks, to keep the build free of extra
+// dependencies.
+//
+//   sabotage_core_test [--filter=SUBSTRING]
+#include "sabotage_core.h"
+#include <cmath>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Frame sizes: degenerate frames, widths on either side of the 16-pixel vector width, and a
+// width past the 256-vector flush interval of the 32-bit lane sums
+const cv::Size kSizes[] = {
+    {1, 1}, {2, 1}, {1, 2}, {3, 3}, {1, 37}, {37, 1}, {2, 3}, {3, 2},
+    {15, 9}, {16, 16}, {17, 5}, {18, 18}, {31, 7}, {33, 31}, {47, 20}, {64, 64},
+    {640, 360}, {257 * 16 + 5, 6},
+};
+
+struct TestCase {
+    std::string name;
+    std::function<void()> run;
+};
+
+// Failures of the test case currently running
+std::vector<std::string> gFailures;
+
+// Helper function to record a failure when actual is not within a relative 1e-9 of expected
+void expectNear(const std::string& what, double actual, double expected) {
+    double tolerance = 1e-9 * std::max(1.0, std::fabs(expected));
+    bool bothNan = std::isnan(actual) && std::isnan(expected);
+    if (!bothNan && !(std::fabs(actual - expected) <= tolerance)) {
+        char message[256];
+        std::snprintf(message, sizeof(message), "%s: got %.12g, expected %.12g", what.c_str(), actual, expected);
+        gFailures.push_back(message);
+    }
+}
+
+std::string sizeName(const cv::Size& size) {
+    return std::to_string(size.width) + "x" + std::to_string(size.height);
+}
+
+// Helper function to fill a frame with pseudo-random values below limit (a fixed-seed LCG,
+// as in the benchmark corpus, so failures reproduce)
+cv::Mat randomPixels(const cv::Size& size, uint32_t seed, int limit) {
+    cv::Mat image(size, CV_8UC1);
+    uint32_t state = seed * 2654435761u + 1u;
+    for (int y = 0; y < image.rows; y++) {
+        uchar* row = image.ptr<uchar>(y);
+        for (int x = 0; x < image.cols; x++) {
+            state = state * 1664525u + 1013904223u;
+            row[x] = static_cast<uchar>((state >> 24) % limit);
+        }
+    }
+    return image;
+}
+
+cv::Mat randomFrame(const cv::Size& size, uint32_t seed) {
+    return randomPixels(size, seed, 256);
+}
+
+// Helper function to make a random mask of 0/255 pixels, about half of them analysed
+cv::Mat randomMask(const cv::Size& size, uint32_t seed) {
+    cv::Mat mask = randomPixels(size, seed ^ 0x5bd1e995u, 2);
+    for (int y = 0; y < mask.rows; y++) {
+        uchar* row = mask.ptr<uchar>(y);
+        for (int x = 0; x < mask.cols; x++) row[x] = row[x] ? 255 : 0;
+    }
+    return mask;
+}
+
+// Reference Laplacian variance: cv::Laplacian(ksize = 1) with BORDER_REFLECT_101, then
+// cv::meanStdDev over the mask
+double referenceLaplacianVariance(const cv::Mat& gray, const cv::Mat& mask) {
+    cv::Mat laplacian;
+    cv::Laplacian(gray, laplacian, CV_64F, 1, 1.0, 0.0, cv::BORDER_REFLECT_101);
+    if (!mask.empty() && cv::countNonZero(mask) == 0) return 0.0;
+    cv::Scalar mean, stddev;
+    cv::meanStdDev(laplacian, mean, stddev, mask);
+    return stddev[0] * stddev[0];
+}
+
+// Reference count of pixels whose L1 Sobel magnitude reaches threshold, inside the mask
+double referenceStrongGradients(const cv::Mat& gray, const cv::Mat& mask, int threshold) {
+    cv::Mat gx, gy;
+    cv::Sobel(gray, gx, CV_16S, 1, 0, 3, 1.0, 0.0, cv::BORDER_REFLECT_101);
+    cv::Sobel(gray, gy, CV_16S, 0, 1, 3, 1.0, 0.0, cv::BORDER_REFLECT_101);
+    double count = 0.0;
+    for (int y = 0; y < gray.rows; y++) {
+        const short* rowX = gx.ptr<short>(y);
+        const short* rowY = gy.ptr<short>(y);
+        const uchar* maskRow = mask.empty() ? nullptr : mask.ptr<uchar>(y);
+        for (int x = 0; x < gray.cols; x++) {
+            if (maskRow && !maskRow[x]) continue;
+            if (std::abs(rowX[x]) + std::abs(rowY[x]) >= threshold) count++;
+        }
+    }
+    return count;
+}
+
+// Reference features of a frame from OpenCV primitives only, as the score functions read them
+FrameFeatures referenceFeatures(const cv::Mat& gray, const cv::Mat& mask, const cv::Mat& laplacian,
+                                const cv::Mat& edges) {
+    FrameFeatures features;
+    int channels[] = {0};
+    int bins[] = {256};
+    float range[] = {0.0f, 256.0f};
+    const float* ranges[] = {range};
+    cv::Mat histogram;
+    cv::calcHist(&gray, 1, channels, mask, histogram, 1, bins, ranges);
+    for (int i = 0; i < 256; i++) {
+        features.histogram[i] = static_cast<uint32_t>(histogram.at<float>(i));
+    }
+    features.totalPixels = mask.empty() ? static_cast<double>(gray.total()) : cv::countNonZero(mask);
+
+    cv::Scalar mean, stddev;
+    cv::meanStdDev(gray, mean, stddev, mask);
+    features.mean = mean[0];
+    features.stddev = stddev[0];
+    cv::meanStdDev(laplacian, mean, stddev, mask);
+    features.laplacianVariance = stddev[0] * stddev[0];
+    cv::Mat maskedEdges = edges.clone();
+    if (!mask.empty()) cv::bitwise_and(edges, mask, maskedEdges);
+    features.edgeDensity = cv::countNonZero(maskedEdges) / features.totalPixels;
+    features.hasIntensityStats = features.hasLaplacian = features.hasEdges = true;
+    return features;
+}
+
+void expectScores(const std::string& what, const SabotageScores& actual, const SabotageScores& expected) {
+    expectNear(what + " defocus", actual.defocusScore, expected.defocusScore);
+    expectNear(what + " blackout", actual.blackoutScore, expected.blackoutScore);
+    expectNear(what + " flash", actual.flashScore, expected.flashScore);
+    expectNear(what + " smear", actual.smearScore, expected.smearScore);
+}
+
+// Helper function to run a check on every size, unmasked and masked, with and without
+// intra-frame row stripes
+void forEachFrame(const std::function<void(const std::string&, const cv::Mat&, const cv::Mat&)>& check) {
+    uint32_t seed = 1;
+    for (const cv::Size& size : kSizes) {
+        cv::Mat gray = randomFrame(size, seed);
+        cv::Mat mask = randomMask(size, seed);
+        seed++;
+        for (bool intraFrame : {false, true}) {
+            parallelismConfig().intraFrame.store(intraFrame);
+            std::string name = sizeName(size) + (intraFrame ? " intraFrame" : "");
+            check(name, gray, cv::Mat());
+            check(name + " masked", gray, mask);
+        }
+    }
+    parallelismConfig().intraFrame.store(false);
+}
+
+void testLaplacianVariance() {
+    forEachFrame([](const std::string& name, const cv::Mat& gray, const cv::Mat& mask) {
+        FrameFeatures features;
+        computeStructureStage(gray, mask, 1, kMetricDefocus, features);
+        expectNear(name, features.laplacianVariance, referenceLaplacianVariance(gray, mask));
+    });
+}
+
+void testGradientEdges() {
+    // Runs the Sobel test inside the Laplacian pass; the threshold and weight are those of
+    // the gradient edge estimator
+    forEachFrame([](const std::string& name, const cv::Mat& gray, const cv::Mat& mask) {
+        FrameFeatures features;
+        computeStructureStage(gray, mask, 1, kMetricSmear, features, EdgeEstimator::Gradient);
+        double pixels = mask.empty() ? static_cast<double>(gray.total()) : cv::countNonZero(mask);
+        double expected = pixels > 0 ? referenceStrongGradients(gray, mask, 150) * 0.5 / pixels : 0.0;
+        expectNear(name + " edge density", features.edgeDensity, expected);
+        expectNear(name + " variance", features.laplacianVariance, referenceLaplacianVariance(gray, mask));
+    });
+}
+
+void testHistogram() {
+    forEachFrame([](const std::string& name, const cv::Mat& gray, const cv::Mat& mask) {
+        FrameFeatures features;
+        computeHistogramStage(gray, mask, kMetricBlackout, features);
+        int channels[] = {0};
+        int bins[] = {256};
+        float range[] = {0.0f, 256.0f};
+        const float* ranges[] = {range};
+        cv::Mat histogram;
+        cv::calcHist(&gray, 1, channels, mask, histogram, 1, bins, ranges);
+        for (int i = 0; i < 256; i++) {
+            expectNear(name + " bin " + std::to_string(i), features.histogram[i], histogram.at<float>(i));
+        }
+        if (features.totalPixels == 0) return;
+        cv::Scalar mean, stddev;
+        cv::meanStdDev(gray, mean, stddev, mask);
+        expectNear(name + " mean", features.mean, mean[0]);
+        expectNear(name + " stddev", features.stddev, stddev[0]);
+    });
+}
+
+// Helper function to check grid mode on one frame: every tile against reference features of
+// its rectangle (the Laplacian and edges taken from the whole frame, as tiles see their
+// neighbours), and the merged frame-level scores against the frame-level path
+void checkGrid(const std::string& name, const cv::Mat& gray, const cv::Mat& mask, int rows, int cols) {
+    AnalysisOptions options;
+    if (!mask.empty()) {
+        auto region = std::make_shared<AnalysisRegion>();
+        region->mask = mask;
+        options.region = region;
+    }
+    SabotageScores frameScores = computeSabotageScores(gray, options);
+    options.gridRows = rows;
+    options.gridCols = cols;
+    SabotageScores gridScores = computeSabotageScores(gray, options);
+    expectScores(name + " frame", gridScores, frameScores);
+    if (!gridScores.grid || gridScores.grid->tiles.size() != static_cast<size_t>(rows * cols)) {
+        gFailures.push_back(name + ": missing tile scores");
+        return;
+    }
+
+    cv::Mat laplacian, edges;
+    cv::Laplacian(gray, laplacian, CV_64F, 1, 1.0, 0.0, cv::BORDER_REFLECT_101);
+    cv::Canny(gray, edges, 50, 150);
+    for (int r = 0; r < rows; r++) {
+        for (int c = 0; c < cols; c++) {
+            // Tile bounds round up, as in grid mode
+            int x0 = (c * gray.cols + cols - 1) / cols, x1 = ((c + 1) * gray.cols + cols - 1) / cols;
+            int y0 = (r * gray.rows + rows - 1) / rows, y1 = ((r + 1) * gray.rows + rows - 1) / rows;
+            cv::Rect tile(x0, y0, x1 - x0, y1 - y0);
+            cv::Mat tileMask = mask.empty() ? cv::Mat() : mask(tile);
+            if (tile.area() == 0 || (!tileMask.empty() && cv::countNonZero(tileMask) == 0)) continue;
+
+            FrameFeatures features = referenceFeatures(gray(tile), tileMask, laplacian(tile), edges(tile));
+            SabotageScores expected;
+            expected.defocusScore = calculateDefocusScore(features);
+            expected.blackoutScore = calculateBlackoutScore(features);
+            expected.flashScore = calculateFlashScore(features);
+            expected.smearScore = calculateSmearScore(features, expected.defocusScore);
+            expectScores(name + " tile " + std::to_string(r) + "," + std::to_string(c),
+                         gridScores.grid->tiles[static_cast<size_t>(r * cols + c)], expected);
+        }
+    }
+}
+
+void testGridSums() {
+    const struct {
+        int rows;
+        int cols;
+    } kGrids[] = {{1, 1}, {2, 3}, {4, 4}, {3, 16}};
+    uint32_t seed = 100;
+    for (const cv::Size& size : kSizes) {
+        if (size.width < 16 || size.height < 4) continue;  // Grids need a pixel row per tile
+        cv::Mat gray = randomFrame(size, seed);
+        cv::Mat mask = randomMask(size, seed);
+        seed++;
+        for (const auto& grid : kGrids) {
+            if (grid.rows > size.height || grid.cols > size.width) continue;
+            std::string name = sizeName(size) + " grid " + std::to_string(grid.rows) + "x" + std::to_string(grid.cols);
+            checkGrid(name, gray, cv::Mat(), grid.rows, grid.cols);
+            checkGrid(name + " masked", gray, mask, grid.rows, grid.cols);
+        }
+    }
+}
+
+// Helper function to read the value of a --name=value flag
+bool readFlag(const char* arg, const char* name, std::string& value) {
+    size_t length = std::strlen(name);
+    if (std::strncmp(arg, name, length) != 0 || arg[length] != '=') return false;
+    value = arg + length + 1;
+    return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    std::string filter;
+    for (int i = 1; i < argc; i++) {
+        if (readFlag(argv[i], "--filter", filter)) continue;
+        std::fprintf(stderr, "Unknown argument: %s\n", argv[i]);
+        return 2;
+    }
+
+    const TestCase tests[] = {
+        {"laplacian_variance", testLaplacianVariance},
+        {"gradient_edges", testGradientEdges},
+        {"histogram", testHistogram},
+        {"grid_sums", testGridSums},
+    };
+
+    cv::setNumThreads(0);
+    int failed = 0;
+    for (const TestCase& test : tests) {
+        if (!filter.empty() && test.name.find(filter) == std::string::npos) continue;
+        gFailures.clear();
+        try {
+            test.run();
+        } catch (const std::exception& e) {
+            gFailures.push_back(std::string("exception: ") + e.what());
+        }
+        std::printf("%-24s %s\n", test.name.c_str(), gFailures.empty() ? "ok" : "FAILED");
+        // The first few mismatches are enough to locate a kernel bug
+        for (size_t i = 0; i < gFailures.size() && i < 10; i++) {
+            std::printf("    %s\n", gFailures[i].c_str());
+        }
+        if (gFailures.size() > 10) std::printf("    ... %zu more\n", gFailures.size() - 10);
+        if (!gFailures.empty()) failed++;
+    }
+    return failed == 0 ? 0 : 1;
+}